@@ -0,0 +1,66 @@
+// BuddyAllocator.h
+
+#ifndef BUDDY_ALLOCATOR_H
+#define BUDDY_ALLOCATOR_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * Buddy-system allocator for physical frames.
+ * A block of order k is 2^k contiguous 4KB frames, aligned to its own size.
+ * Orders run from 0 (4KB) to 18 (1GB), one free list per order.
+ * Free lists are intrusive doubly-linked lists threaded through per-frame
+ * next/prev arrays, so unlinking a buddy while coalescing is O(1) and
+ * allocate/free are O(log n) in the number of orders.
+ * The frames managed can start at any firstPfn (one allocator per memory tier);
+ * blocks stay aligned in the global pfn space.
+ */
+
+const int BUDDY_MAX_ORDER = 18;
+const uint32_t NO_FRAME = UINT32_MAX;
+
+class BuddyAllocator {
+private:
+    uint32_t firstPfn;
+    size_t numFrames;
+    size_t freeFrameCount;
+    uint32_t freeHead[BUDDY_MAX_ORDER + 1];
+    vector<uint32_t> next;
+    vector<uint32_t> prev;
+    vector<int8_t> freeOrder;    // order of the free block starting at this frame, -1 otherwise
+    vector<int8_t> allocOrder;   // order of the allocated block starting at this frame, -1 otherwise
+
+    void pushFree(uint32_t pfn, int order);
+    void unlinkFree(uint32_t pfn, int order);
+    size_t index(uint32_t pfn) const { return pfn - firstPfn; }
+
+public:
+    BuddyAllocator(size_t numFrames, uint32_t firstPfn = 0);
+
+    // allocate an aligned block of 2^order frames, return its first pfn or NO_FRAME
+    uint32_t allocate(int order);
+
+    // return the block starting at pfn to the free lists, merging with free buddies
+    void free(uint32_t pfn);
+
+    // turn the allocated block starting at pfn into single-frame blocks, so its frames
+    // can be freed one by one (and coalesce again once all of them are free)
+    void split(uint32_t pfn);
+
+    // true if pfn is one of this allocator's frames
+    bool contains(uint32_t pfn) const;
+    // true if an allocated block starts at pfn
+    bool isAllocated(uint32_t pfn) const;
+    int blockOrder(uint32_t pfn) const;
+
+    // first frame of the smallest free block, NO_FRAME if memory is full
+    uint32_t peekFree() const;
+
+    size_t freeBytes() const;
+};
+
+#endif // BUDDY_ALLOCATOR_H
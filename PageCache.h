@@ -0,0 +1,375 @@
+// PageCache.h
+
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std;
+
+/**
+ * Page cache engines behind os::accessCacheHuge / os::accessCache4KB.
+ * Every policy keeps its entries in a fixed node pool linked by index
+ * (intrusive lists, no per-access allocation) and finds keys through a hash
+ * map, so a hit, a miss and an eviction are all O(1).
+ *   LFU: frequency buckets in increasing order, each an LRU list of its keys;
+ *        the victim is the oldest key of the lowest-frequency bucket.
+ *   LRU: one recency list.
+ *   ARC: adaptive replacement cache (T1/T2 resident lists, B1/B2 ghost lists).
+ */
+
+enum CachePolicy {
+    CACHE_LFU,
+    CACHE_LRU,
+    CACHE_ARC
+};
+
+struct CacheConfig {
+    CachePolicy policy = CACHE_LFU;
+    uint32_t capacity = 512;
+};
+
+const uint32_t NIL = UINT32_MAX;
+
+// head/tail of a list threaded through a node pool; head is the least recent end
+struct IndexList {
+    uint32_t head = NIL;
+    uint32_t tail = NIL;
+    uint32_t size = 0;
+};
+
+// link / unlink pool nodes that carry prev and next indices
+template <typename Node>
+void listPushBack(vector<Node>& pool, IndexList& list, uint32_t idx) {
+    pool[idx].prev = list.tail;
+    pool[idx].next = NIL;
+    if (list.tail != NIL) {
+        pool[list.tail].next = idx;
+    } else {
+        list.head = idx;
+    }
+    list.tail = idx;
+    list.size++;
+}
+
+template <typename Node>
+void listInsertAfter(vector<Node>& pool, IndexList& list, uint32_t pos, uint32_t idx) {
+    if (pos == NIL) {   // insert at the front
+        pool[idx].prev = NIL;
+        pool[idx].next = list.head;
+        if (list.head != NIL) {
+            pool[list.head].prev = idx;
+        } else {
+            list.tail = idx;
+        }
+        list.head = idx;
+    } else {
+        pool[idx].prev = pos;
+        pool[idx].next = pool[pos].next;
+        if (pool[pos].next != NIL) {
+            pool[pool[pos].next].prev = idx;
+        } else {
+            list.tail = idx;
+        }
+        pool[pos].next = idx;
+    }
+    list.size++;
+}
+
+template <typename Node>
+void listUnlink(vector<Node>& pool, IndexList& list, uint32_t idx) {
+    if (pool[idx].prev != NIL) {
+        pool[pool[idx].prev].next = pool[idx].next;
+    } else {
+        list.head = pool[idx].next;
+    }
+    if (pool[idx].next != NIL) {
+        pool[pool[idx].next].prev = pool[idx].prev;
+    } else {
+        list.tail = pool[idx].prev;
+    }
+    list.size--;
+}
+
+
+template <typename Key, typename Hash = typename Key::Hash>
+class PageCache {
+public:
+    virtual ~PageCache() {}
+    // look the key up; on a miss insert it, evicting a victim when full
+    // return true on hit
+    virtual bool access(const Key& key) = 0;
+    virtual size_t size() const = 0;
+};
+
+
+template <typename Key, typename Hash = typename Key::Hash>
+class LfuCache : public PageCache<Key, Hash> {
+private:
+    struct Item {
+        Key key;
+        uint32_t bucket;
+        uint32_t prev, next;
+    };
+    struct Bucket {
+        uint64_t freq;
+        IndexList items;
+        uint32_t prev, next;
+    };
+    uint32_t capacity;
+    vector<Item> items;
+    vector<Bucket> buckets;
+    vector<uint32_t> freeBuckets;
+    IndexList bucketList;          // ordered by increasing frequency
+    unordered_map<Key, uint32_t, Hash> index;
+
+    // new bucket for freq, placed right after pos (NIL = front)
+    uint32_t newBucket(uint64_t freq, uint32_t pos) {
+        uint32_t b;
+        if (!freeBuckets.empty()) {
+            b = freeBuckets.back();
+            freeBuckets.pop_back();
+        } else {
+            b = buckets.size();
+            buckets.push_back(Bucket());
+        }
+        buckets[b].freq = freq;
+        buckets[b].items = IndexList();
+        listInsertAfter(buckets, bucketList, pos, b);
+        return b;
+    }
+
+    void releaseBucketIfEmpty(uint32_t b) {
+        if (buckets[b].items.size == 0) {
+            listUnlink(buckets, bucketList, b);
+            freeBuckets.push_back(b);
+        }
+    }
+
+public:
+    LfuCache(uint32_t capacity) : capacity(capacity) {
+        items.reserve(capacity);
+        buckets.reserve(capacity + 1);
+        index.reserve(capacity);
+    }
+
+    bool access(const Key& key) override {
+        auto it = index.find(key);
+        if (it != index.end()) {
+            // hit: move the item to the bucket of freq + 1
+            uint32_t i = it->second;
+            uint32_t b = items[i].bucket;
+            uint32_t nb = buckets[b].next;
+            if (nb == NIL || buckets[nb].freq != buckets[b].freq + 1) {
+                nb = newBucket(buckets[b].freq + 1, b);
+            }
+            listUnlink(items, buckets[b].items, i);
+            listPushBack(items, buckets[nb].items, i);
+            items[i].bucket = nb;
+            releaseBucketIfEmpty(b);
+            return true;
+        }
+        if (capacity == 0) {
+            return false;
+        }
+        uint32_t i;
+        if (index.size() >= capacity) {
+            // evict the oldest item of the least frequently used bucket
+            uint32_t b = bucketList.head;
+            i = buckets[b].items.head;
+            listUnlink(items, buckets[b].items, i);
+            index.erase(items[i].key);
+            releaseBucketIfEmpty(b);
+            items[i].key = key;
+        } else {
+            i = items.size();
+            items.push_back(Item{key, NIL, NIL, NIL});
+        }
+        uint32_t b = bucketList.head;
+        if (b == NIL || buckets[b].freq != 1) {
+            b = newBucket(1, NIL);
+        }
+        listPushBack(items, buckets[b].items, i);
+        items[i].bucket = b;
+        index.emplace(key, i);
+        return false;
+    }
+
+    size_t size() const override {
+        return index.size();
+    }
+};
+
+
+template <typename Key, typename Hash = typename Key::Hash>
+class LruCache : public PageCache<Key, Hash> {
+private:
+    struct Item {
+        Key key;
+        uint32_t prev, next;
+    };
+    uint32_t capacity;
+    vector<Item> items;
+    IndexList recency;     // head is least recently used
+    unordered_map<Key, uint32_t, Hash> index;
+
+public:
+    LruCache(uint32_t capacity) : capacity(capacity) {
+        items.reserve(capacity);
+        index.reserve(capacity);
+    }
+
+    bool access(const Key& key) override {
+        auto it = index.find(key);
+        if (it != index.end()) {
+            listUnlink(items, recency, it->second);
+            listPushBack(items, recency, it->second);
+            return true;
+        }
+        if (capacity == 0) {
+            return false;
+        }
+        uint32_t i;
+        if (index.size() >= capacity) {
+            i = recency.head;
+            listUnlink(items, recency, i);
+            index.erase(items[i].key);
+            items[i].key = key;
+        } else {
+            i = items.size();
+            items.push_back(Item{key, NIL, NIL});
+        }
+        listPushBack(items, recency, i);
+        index.emplace(key, i);
+        return false;
+    }
+
+    size_t size() const override {
+        return index.size();
+    }
+};
+
+
+template <typename Key, typename Hash = typename Key::Hash>
+class ArcCache : public PageCache<Key, Hash> {
+private:
+    enum ListId { T1, T2, B1, B2 };
+    struct Item {
+        Key key;
+        ListId list;
+        uint32_t prev, next;
+    };
+    uint32_t capacity;
+    uint32_t target;       // adaptive target size of T1 ("p")
+    vector<Item> items;    // resident and ghost entries, at most 2 * capacity
+    vector<uint32_t> freeItems;
+    IndexList lists[4];
+    unordered_map<Key, uint32_t, Hash> index;
+
+    void moveTo(uint32_t i, ListId to) {
+        listUnlink(items, lists[items[i].list], i);
+        items[i].list = to;
+        listPushBack(items, lists[to], i);
+    }
+
+    void discardLru(ListId from) {
+        uint32_t i = lists[from].head;
+        listUnlink(items, lists[from], i);
+        index.erase(items[i].key);
+        freeItems.push_back(i);
+    }
+
+    // demote the LRU page of T1 or T2 to its ghost list
+    void replace(bool inB2) {
+        if (lists[T1].size > 0 && (lists[T2].size == 0 || lists[T1].size > target || (inB2 && lists[T1].size == target))) {
+            moveTo(lists[T1].head, B1);
+        } else {
+            moveTo(lists[T2].head, B2);
+        }
+    }
+
+public:
+    ArcCache(uint32_t capacity) : capacity(capacity), target(0) {
+        items.reserve(2 * capacity);
+        index.reserve(2 * capacity);
+    }
+
+    bool access(const Key& key) override {
+        auto it = index.find(key);
+        if (it != index.end()) {
+            uint32_t i = it->second;
+            ListId list = items[i].list;
+            if (list == T1 || list == T2) {
+                moveTo(i, T2);
+                return true;
+            }
+            // ghost hit: adapt the target, make room and bring the page back into T2
+            if (list == B1) {
+                uint32_t delta = max<uint32_t>(lists[B2].size / lists[B1].size, 1);
+                target = min(capacity, target + delta);
+                replace(false);
+            } else {
+                uint32_t delta = max<uint32_t>(lists[B1].size / lists[B2].size, 1);
+                target = target > delta ? target - delta : 0;
+                replace(true);
+            }
+            moveTo(i, T2);
+            return false;
+        }
+        if (capacity == 0) {
+            return false;
+        }
+        uint32_t l1 = lists[T1].size + lists[B1].size;
+        uint32_t total = l1 + lists[T2].size + lists[B2].size;
+        if (l1 == capacity) {
+            if (lists[T1].size < capacity) {
+                discardLru(B1);
+                replace(false);
+            } else {
+                discardLru(T1);
+            }
+        } else if (total >= capacity) {
+            if (total == 2 * capacity) {
+                discardLru(B2);
+            }
+            replace(false);
+        }
+        uint32_t i;
+        if (!freeItems.empty()) {
+            i = freeItems.back();
+            freeItems.pop_back();
+            items[i].key = key;
+            items[i].list = T1;
+        } else {
+            i = items.size();
+            items.push_back(Item{key, T1, NIL, NIL});
+        }
+        listPushBack(items, lists[T1], i);
+        index.emplace(key, i);
+        return false;
+    }
+
+    size_t size() const override {
+        return lists[T1].size + lists[T2].size;
+    }
+};
+
+
+template <typename Key, typename Hash = typename Key::Hash>
+unique_ptr<PageCache<Key, Hash>> makePageCache(const CacheConfig& config) {
+    switch (config.policy) {
+    case CACHE_LFU:
+        return unique_ptr<PageCache<Key, Hash>>(new LfuCache<Key, Hash>(config.capacity));
+    case CACHE_LRU:
+        return unique_ptr<PageCache<Key, Hash>>(new LruCache<Key, Hash>(config.capacity));
+    case CACHE_ARC:
+        return unique_ptr<PageCache<Key, Hash>>(new ArcCache<Key, Hash>(config.capacity));
+    }
+    throw invalid_argument("Unknown cache policy");
+}
+
+#endif // PAGE_CACHE_H
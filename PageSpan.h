@@ -0,0 +1,158 @@
+// PageSpan.h
+
+#ifndef PAGE_SPAN_H
+#define PAGE_SPAN_H
+
+#include <cstdint>
+#include "PageTable.h"
+
+using namespace std;
+
+/**
+ * Entry encoding and span layout shared by the page table layouts (TwoLevelPageTable and
+ * RadixPageTable), templated on the width of an in-table entry.
+ *
+ * An entry holds a valid and a present bit, an accessed bit, log2(page_size) - 12 and the pfn
+ * of the frame backing the slot the entry sits in. The accessed bit is kept in the entry of
+ * the page's first piece only.
+ *
+ * A page that is not a leaf is a span: one entry in the PTE page slot where the page starts,
+ * flagged in that PTE page's start bitmap. A lookup takes the nearest start at or below its
+ * slot and checks that the page reaches it.
+ */
+
+// bit positions of an entry width; valid and present are the two top bits of every width
+template <typename Entry> struct EntryLayout;
+
+// 4 bytes: bit 24 accessed, bits 25-29 order, bits 0-19 pfn
+template <> struct EntryLayout<uint32_t> {
+    static constexpr int accessedShift = 24;
+    static constexpr int orderShift = 25;
+    static constexpr int pfnBits = 20;
+};
+
+// 8 bytes: bit 61 accessed, bits 56-60 order, bits 0-31 pfn
+template <> struct EntryLayout<uint64_t> {
+    static constexpr int accessedShift = 61;
+    static constexpr int orderShift = 56;
+    static constexpr int pfnBits = 32;
+};
+
+template <typename Entry>
+struct SpanEntry {
+    typedef EntryLayout<Entry> Layout;
+    static constexpr Entry validBit = Entry(1) << (sizeof(Entry) * 8 - 1);
+    static constexpr Entry presentBit = Entry(1) << (sizeof(Entry) * 8 - 2);
+    static constexpr Entry accessedBit = Entry(1) << Layout::accessedShift;
+    static constexpr Entry orderMask = 0b11111;
+    static constexpr Entry pfnMask = (Entry(1) << Layout::pfnBits) - 1;
+
+    // slot pfn = first frame of the page + offset of the slot inside the page
+    static Entry pack(uint32_t slotPfn, uint32_t pageSize) {
+        Entry order = __builtin_ctz(pageSize) - 12;
+        return validBit | presentBit | (order << Layout::orderShift) | (slotPfn & pfnMask);
+    }
+
+    // entry for the piece of a page that starts at vpn
+    static Entry piece(uint64_t vpn, uint64_t pageVpn, uint32_t pfn, uint32_t pageSize) {
+        return pack(pfn + uint32_t(vpn - pageVpn), pageSize);
+    }
+
+    // Frames come from the buddy allocator, so a page's first frame is aligned to the page
+    // size and the low bits of the slot pfn give the slot's offset inside the page. That
+    // recovers the page's first frame and first vpn even when the virtual address is not
+    // size-aligned.
+    static PTE unpack(Entry bits, uint64_t vpn) {
+        PTE pte;
+        uint32_t slotPfn = bits & pfnMask;
+        uint32_t order = (bits >> Layout::orderShift) & orderMask;
+        uint32_t offset = slotPfn & ((1u << order) - 1);
+        pte.pfn = slotPfn - offset;
+        pte.vpn = vpn - offset;
+        pte.page_size = 4096u << order;
+        pte.present = bits & presentBit;
+        pte.valid = bits & validBit;
+        return pte;
+    }
+
+    // entries are read with relaxed atomic loads: markAccessed() may set the accessed bit of
+    // an entry concurrently (see os::replayOnCores)
+    static Entry load(const Entry& entry) { return __atomic_load_n(&entry, __ATOMIC_RELAXED); }
+
+    // entry is the page's first piece, nullptr when the page is not mapped
+    static void markAccessed(Entry* entry) {
+        if (entry) {
+            __atomic_fetch_or(entry, accessedBit, __ATOMIC_RELAXED);
+        }
+    }
+
+    static bool testAndClearAccessed(Entry* entry) {
+        if (!entry || !(*entry & accessedBit)) {
+            return false;
+        }
+        *entry &= ~accessedBit;
+        return true;
+    }
+};
+
+// PTE page: Slots entries (only span starts are meaningful) plus a bitmap of the slots where
+// a span starts. A span crossing into the next PTE page gets a second start there.
+template <typename Entry, uint32_t Slots>
+struct SpanPage {
+    typedef SpanEntry<Entry> Encoding;
+    static constexpr uint64_t slotMask = Slots - 1;
+
+    Entry entries[Slots] = {};
+    uint64_t starts[Slots / 64] = {};
+
+    // slot of the nearest span start at or below slot, -1 if none
+    int startAtOrBelow(uint32_t slot) const {
+        int word = slot >> 6;
+        // bits 0..slot of the word; slot % 64 == 63 wraps to all ones
+        uint64_t bits = starts[word] & ((2ull << (slot & 63)) - 1);
+        while (!bits) {
+            if (--word < 0) {
+                return -1;
+            }
+            bits = starts[word];
+        }
+        return word * 64 + 63 - __builtin_clzll(bits);
+    }
+
+    void addStart(uint32_t slot, Entry entry) {
+        entries[slot] = entry;
+        starts[slot >> 6] |= 1ull << (slot & 63);
+    }
+
+    void removeStart(uint32_t slot) {
+        entries[slot] = 0;
+        starts[slot >> 6] &= ~(1ull << (slot & 63));
+    }
+
+    // the entry of the span mapping vpn, rebased to vpn's own slot, 0 if none
+    Entry covering(uint64_t vpn) const {
+        int start = startAtOrBelow(vpn & slotMask);
+        if (start < 0) {
+            return 0;
+        }
+        uint64_t startVpn = (vpn & ~slotMask) + start;
+        Entry entry = Encoding::load(entries[start]);
+        PTE page = Encoding::unpack(entry, startVpn);
+        if (vpn - page.vpn >= page.page_size / 4096) {
+            return 0;
+        }
+        return entry + (vpn - startVpn);
+    }
+
+    // the last page starting in the slots from vpn's to lastSlot, false if none
+    bool lastStartIn(uint64_t vpn, uint32_t lastSlot, PTE& page) const {
+        int start = startAtOrBelow(lastSlot);
+        if (start < int(vpn & slotMask)) {
+            return false;
+        }
+        page = Encoding::unpack(entries[start], (vpn & ~slotMask) + start);
+        return true;
+    }
+};
+
+#endif // PAGE_SPAN_H
@@ -0,0 +1,83 @@
+// PageTable.h
+
+#ifndef PAGE_TABLE_H
+#define PAGE_TABLE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+using namespace std;
+
+/**
+ * Per-process page table, as seen by the os.
+ * Two layouts implement it, picked by the width of the virtual address space:
+ *  - 32 bits: TwoLevelPageTable, a 10/10/12 split (4MB leaf PDEs);
+ *  - 48 or 57 bits: RadixPageTable, 4 or 5 levels of 512-entry tables (2MB and 1GB leaves).
+ * Virtual addresses and page numbers are 64-bit everywhere; an address outside the address
+ * space simply has no mapping. Frames stay 32-bit pfns.
+ */
+
+// Decoded view of a page table entry, returned by translate().
+// vpn and pfn are those of the first 4KB of the page.
+struct PTE {
+    uint64_t vpn;
+    uint32_t pfn;
+    uint32_t page_size;
+    bool present;
+    bool valid;
+    PTE(uint64_t vpn, uint32_t pfn, uint32_t page_size);
+    PTE();
+};
+
+// Outcome of a page walk. Faults are reported here instead of by exceptions.
+enum WalkStatus {
+    WALK_OK,
+    WALK_NOT_PRESENT,   // mapped but swapped out: page fault
+    WALK_INVALID        // no mapping: segmentation fault
+};
+
+class PageTable {
+public:
+    virtual ~PageTable() {}
+
+    // map pageSize bytes at vpn to the frames starting at pfn, replacing what was mapped there
+    // pfn must be aligned to pageSize (buddy allocator blocks are)
+    // throws out_of_range when the page does not fit the address space
+    virtual void setMapping(uint32_t pageSize, uint64_t vpn, uint32_t pfn) = 0;
+
+    // walk the table for vaddr; pte is filled in for WALK_OK and WALK_NOT_PRESENT
+    // the caller accounts for the references (and for any page-walk cache in front)
+    virtual WalkStatus translate(uint64_t vaddr, PTE& pte) const = 0;
+
+    // directory entries (every level above the PTE pages) a walk of vaddr reads: it stops
+    // at a leaf, at an empty entry or at the entry pointing to the PTE page
+    virtual uint32_t directoryReads(uint64_t vaddr) const = 0;
+    // true if the walk of vaddr goes on to a PTE page, and so reads one PTE more
+    virtual bool hasPTEPage(uint64_t vaddr) const = 0;
+
+    virtual void free(uint64_t vpn) = 0;
+    virtual void updatePresentBit(uint64_t vpn) = 0;
+
+    // accessed (referenced) bit of the page mapping vpn, for reclaim: set on every access,
+    // read and cleared by the clock hands
+    virtual void markAccessed(uint64_t vpn) = 0;
+    virtual bool testAndClearAccessed(uint64_t vpn) = 0;
+
+    // bytes used by every table and directory currently allocated
+    virtual size_t footprintBytes() const = 0;
+
+    // width of virtual addresses, and of the index into a PTE page
+    virtual int addressBits() const = 0;
+    virtual int pteIndexBits() const = 0;
+
+    uint64_t addressSpaceEnd() const { return 1ull << addressBits(); }
+    // the directory entry pointing to the PTE page of vaddr: what the page-walk cache keeps
+    uint64_t directorySlot(uint64_t vaddr) const { return vaddr >> (12 + pteIndexBits()); }
+};
+
+// table for an address space of addressBits: 32, 48 or 57
+// throws invalid_argument for any other width
+unique_ptr<PageTable> makePageTable(int pid, int addressBits);
+
+#endif // PAGE_TABLE_H
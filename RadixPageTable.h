@@ -0,0 +1,100 @@
+// RadixPageTable.h
+
+#ifndef RADIX_PAGE_TABLE_H
+#define RADIX_PAGE_TABLE_H
+
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "PageTable.h"
+#include "PageSpan.h"
+
+using namespace std;
+
+/**
+ * x86-64 style page table for the 64-bit address modes: 4 levels of 512-entry tables for
+ * 48-bit addresses (9/9/9/9/12), 5 levels for 57-bit ones. Level 0 is the PTE page, level 1
+ * the page directory (2MB per entry), level 2 the PDPT (1GB per entry), and so on up to the
+ * root, which always exists.
+ *
+ * Every table below the root is allocated on the first mapping under it and released with
+ * its last mapping, so the table costs memory in proportion to the mapped footprint, not to
+ * the size of the address space.
+ *
+ * Pages are laid out as in TwoLevelPageTable:
+ *  - a page that starts on a 1GB (2MB) boundary and is at least that large is a leaf in
+ *    the PDPT (page directory), one per slot it covers;
+ *  - every other page is a span in the PTE pages it touches (see PageSpan.h).
+ */
+
+// In-table entry, PTE or leaf: 8 bytes, encoded by SpanEntry<uint64_t>.
+typedef uint64_t RadixEntry;
+
+// a table of any level; the level it sits at tells which one it is
+struct RadixNode {
+    virtual ~RadixNode() {}
+};
+
+// Level 0: 512 PTEs, their start bitmap and the number of 4KB pages covered by spans.
+struct alignas(64) RadixPTEPage : RadixNode, SpanPage<RadixEntry, 512> {
+    uint32_t live = 0;
+};
+
+// Levels 1 and up: a slot holds a leaf, a table of the level below, or nothing.
+struct RadixDirectory : RadixNode {
+    RadixEntry leaves[512] = {};
+    unique_ptr<RadixNode> children[512];
+    uint32_t used = 0;      // slots holding a leaf or a table
+};
+
+class RadixPageTable : public PageTable {
+private:
+    static const int MAX_LEVELS = 5;
+    uint32_t pid;
+    int levels;
+    unique_ptr<RadixDirectory> root;
+    size_t directories = 0;     // below the root
+    size_t ptePages = 0;
+    typedef SpanEntry<RadixEntry> Encoding;
+
+    // the entry mapping vpn, rebased to vpn's own slot, 0 if unmapped
+    RadixEntry lookup(uint64_t vpn) const;
+    // directory where a walk of vpn stops (at a leaf, an empty slot or level 1), and its level
+    const RadixDirectory* walkTo(uint64_t vpn, int& level) const;
+    // the same walk, keeping the directories passed: path[l] is the one of level l
+    int descend(uint64_t vpn, RadixDirectory* path[]);
+    // directory of level covering vpn, allocating the missing ones on the way
+    RadixDirectory* directoryFor(uint64_t vpn, int level);
+    // release the directories of path emptied by a removal at level, bottom up
+    void prune(RadixDirectory* path[], uint64_t vpn, int level);
+    // level of the leaves of a page, 0 when it is laid out as spans
+    static int leafLevel(uint64_t vpn, uint64_t numPages);
+    // unmap every page overlapping [vpn, vpn + numPages)
+    void unmapOverlapping(uint64_t vpn, uint64_t numPages);
+    // remove the page starting at pageVpn, given its length in 4KB pages
+    void unmapPage(uint64_t pageVpn, uint64_t numPages);
+    // entry of the first piece of the page mapping vpn, nullptr if unmapped
+    RadixEntry* firstPieceEntry(uint64_t vpn);
+
+public:
+    // levels: 4 (48-bit addresses) or 5 (57-bit)
+    RadixPageTable(int pidGiven, int levels);
+
+    void setMapping(uint32_t pageSize, uint64_t vpn, uint32_t pfn) override;
+    WalkStatus translate(uint64_t vaddr, PTE& pte) const override;
+    uint32_t directoryReads(uint64_t vaddr) const override;
+    bool hasPTEPage(uint64_t vaddr) const override;
+
+    void free(uint64_t vpn) override;
+    void updatePresentBit(uint64_t vpn) override;
+    void markAccessed(uint64_t vpn) override;
+    bool testAndClearAccessed(uint64_t vpn) override;
+
+    // the root plus every allocated directory and PTE page
+    size_t footprintBytes() const override;
+
+    int addressBits() const override { return 12 + 9 * levels; }
+    int pteIndexBits() const override { return 9; }
+};
+
+#endif // RADIX_PAGE_TABLE_H
@@ -0,0 +1,67 @@
+// Simulation.h
+
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdint>
+#include "os.h"
+#include "tlb.h"
+#include "PageCache.h"
+#include "Trace.h"
+#include "Stats.h"
+
+using namespace std;
+
+/**
+ * One simulation = one trace replayed through a fresh os with one configuration.
+ * All state, counters included, lives in the os instance, so runSweep() can run
+ * many simulations at once on a ThreadPool.
+ */
+
+struct SimulationParams {
+    string traceFile;
+    bool cacheChoice = false;              // 1 huge pages, 0 subpages
+    TlbConfig tlbConfig;
+    CacheConfig cacheConfig;
+    CostModel costModel;
+    ThpConfig thpConfig;
+    TieringConfig tieringConfig;
+    size_t memorySize = 1ULL << 32;        // ignored when tieringConfig lists the tiers
+    size_t diskSize = 10ULL << 30;         // swap device size
+    string swapDirectory;                  // empty: $TMPDIR or /tmp
+    size_t highWatermark = 0;              // bytes, 0: 1/20 of memory
+    size_t lowWatermark = 0;               // bytes, 0: 1/40 of memory
+    ReclaimConfig reclaimConfig;
+    uint32_t cores = 1;                    // simulated cpus, each with its own tlbs
+    bool parallel = false;                 // replay every core on a host thread of its own
+    int addressBits = 32;                  // virtual address width: 32, 48 or 57
+};
+
+struct SimulationResult {
+    SimulationParams params;
+    SimStats stats;
+    double seconds = 0;
+    string error;                          // empty when the run completed
+};
+
+// feed every record of the trace to the os, in order or core by core on parallel threads
+// (os::replayOnCores), then stop its background reclaim
+void replayTrace(os& osInstance, TraceReader& trace, bool parallel = false);
+
+// run one simulation; failures are reported in SimulationResult::error
+SimulationResult runSimulation(const SimulationParams& params);
+
+// run every simulation on a work-stealing pool, results in the order of runs
+// numThreads == 0 uses one thread per hardware thread
+vector<SimulationResult> runSweep(const vector<SimulationParams>& runs, size_t numThreads);
+
+// one header line, then one line per result
+void writeSweepCsv(ostream& out, const vector<SimulationResult>& results);
+
+// JSON array with the parameters and the full statistics (SimStats::writeJson) of every run
+void writeSweepJson(ostream& out, const vector<SimulationResult>& results);
+
+#endif // SIMULATION_H
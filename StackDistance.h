@@ -0,0 +1,141 @@
+// StackDistance.h
+
+#ifndef STACK_DISTANCE_H
+#define STACK_DISTANCE_H
+
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
+#include <unordered_map>
+
+using namespace std;
+
+/**
+ * Single-pass LRU stack-distance (Mattson) analysis.
+ * The stack distance of an access is the number of distinct keys touched since
+ * the previous access to the same key. An LRU structure of capacity C hits
+ * exactly the accesses whose distance is below C, so one histogram of
+ * distances gives the hit rate of every capacity at once.
+ *
+ * Distances are computed with a Fenwick tree over access timestamps: the
+ * position of each key's most recent access holds a 1, and the distance is the
+ * number of ones after the key's previous position, O(log n) per access.
+ * Timestamps are renumbered when the tree fills up, so memory stays
+ * proportional to the number of distinct keys.
+ */
+
+// prefix sums over positions 1..size
+class FenwickTree {
+private:
+    vector<int32_t> tree;
+
+public:
+    explicit FenwickTree(size_t size = 0) : tree(size + 1, 0) {}
+
+    size_t size() const { return tree.size() - 1; }
+    void add(size_t pos, int32_t delta);
+    // sum of positions 1..pos
+    int64_t prefix(size_t pos) const;
+};
+
+// counts of stack distances plus cold (first-touch) accesses
+class ReuseHistogram {
+private:
+    vector<uint64_t> counts;    // counts[d] = accesses at distance d
+    uint64_t cold = 0;
+    uint64_t total = 0;
+
+public:
+    void addDistance(size_t distance);
+    void addCold();
+    // halve every count, so older behaviour weighs less
+    void decay();
+
+    uint64_t accesses() const { return total; }
+    uint64_t coldAccesses() const { return cold; }
+    // largest capacity that still gains hits
+    size_t maxUsefulCapacity() const { return counts.size(); }
+
+    // hits of an LRU structure holding capacity keys
+    uint64_t hits(size_t capacity) const;
+    double hitRate(size_t capacity) const;
+};
+
+template <typename Key, typename Hash = typename Key::Hash>
+class StackDistanceProfiler {
+private:
+    FenwickTree tree;
+    unordered_map<Key, uint32_t, Hash> lastAccess;   // key -> timestamp of its latest access
+    uint32_t clock = 0;
+    ReuseHistogram histogram;
+
+    // renumber the live timestamps 1..k in order and rebuild the tree with room to grow
+    void compact() {
+        vector<uint32_t*> live;
+        live.reserve(lastAccess.size());
+        for (auto& entry : lastAccess) {
+            live.push_back(&entry.second);
+        }
+        sort(live.begin(), live.end(), [](const uint32_t* a, const uint32_t* b) { return *a < *b; });
+        tree = FenwickTree(max<size_t>(2 * live.size(), 1024));
+        clock = 0;
+        for (uint32_t* timestamp : live) {
+            *timestamp = ++clock;
+            tree.add(clock, 1);
+        }
+    }
+
+public:
+    StackDistanceProfiler() : tree(1024) {}
+
+    void access(const Key& key) {
+        if (clock == tree.size()) {
+            compact();
+        }
+        uint32_t now = ++clock;
+        auto it = lastAccess.find(key);
+        if (it != lastAccess.end()) {
+            histogram.addDistance(tree.prefix(now - 1) - tree.prefix(it->second));
+            tree.add(it->second, -1);
+            it->second = now;
+        } else {
+            histogram.addCold();
+            lastAccess.emplace(key, now);
+        }
+        tree.add(now, 1);
+    }
+
+    // forget the contents (a flush), the histogram is kept
+    void flush() {
+        lastAccess.clear();
+        tree = FenwickTree(tree.size());
+        clock = 0;
+    }
+
+    const ReuseHistogram& result() const { return histogram; }
+    void decay() { histogram.decay(); }
+};
+
+// translation stream key: one TLB entry per (pid, first vpn of the page)
+struct TranslationKey {
+    uint32_t pid;
+    uint64_t vpn;
+
+    bool operator==(const TranslationKey& other) const {
+        return pid == other.pid && vpn == other.vpn;
+    }
+
+    struct Hash {
+        size_t operator()(const TranslationKey& key) const {
+            return std::hash<uint64_t>()((uint64_t(key.pid) << 32) ^ key.vpn);
+        }
+    };
+};
+
+// CSV: capacity, then the LRU hit rate of each named histogram at that capacity
+// capacities run over the powers of two up to the largest useful one, plus any extra ones
+void writeHitRateCurves(ostream& out, const vector<pair<string, const ReuseHistogram*>>& curves,
+                        vector<size_t> extraCapacities);
+
+#endif // STACK_DISTANCE_H
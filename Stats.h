@@ -0,0 +1,222 @@
+// Stats.h
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+/**
+ * Statistics registry of one simulation. Each os instance owns one and hands
+ * it to its Tlb, so several simulations can run side by side in one process.
+ * All counters are 64-bit.
+ *
+ * The flat counters are the totals. Every translated access is also recorded
+ * (record()) per segment, per process, per simulated core and per page size,
+ * each breakdown split by the TLB level that served it. writeJson() / writeCsv()
+ * export everything so analysis does not have to parse the text report.
+ *
+ * A CostModel turns the events of each access into cycles, split by component;
+ * the cycle totals and AMAT (cycles per access) are reported per bucket so runs with
+ * different page sizes and cache modes can be compared on time instead of hit rates.
+ */
+
+enum Segment {
+    SEG_CODE,
+    SEG_STACK,
+    SEG_HEAP,
+    SEG_COUNT
+};
+
+const char* segmentName(Segment segment);
+
+// where the cycles of an access go
+enum CostComponent {
+    COST_L1_TLB,
+    COST_L2_TLB,
+    COST_WALK_PDE,      // directory reads of the walk
+    COST_WALK_PTE,      // PTE reads of the walk
+    COST_DATA,          // the data access itself: page cache hit or memory
+    COST_PAGE_FAULT,
+    COST_SWAP,          // swap reads on faults, swap writes on reclaim
+    COST_MIGRATION,     // page copies between memory tiers
+    COST_SHOOTDOWN,     // tlb shootdowns: waiting for the acks, handling the interrupt
+    COST_COUNT
+};
+
+const char* costComponentName(CostComponent component);
+
+// latency of each event in cycles
+struct CostModel {
+    uint32_t l1_tlb = 1;            // every access
+    uint32_t l2_tlb = 7;            // every l1 miss
+    uint32_t walk_pde = 30;         // per directory read (skipped on a page-walk cache hit)
+    uint32_t walk_pte = 30;         // per PTE read
+    uint32_t cache_hit = 50;        // data access served by the page cache
+    uint32_t cache_miss = 200;      // data access served by memory: page cache miss or page not cached
+                                    // (the latency of the only tier unless tiers are configured)
+    uint32_t page_fault = 2000;     // trap and handler, without the swap read
+    uint32_t swap_read = 100000;    // per 4KB page
+    uint32_t swap_write = 100000;   // per 4KB page
+    uint32_t shootdown = 4000;      // per shootdown round, on the initiating core: send the IPIs
+                                    // and wait for every ack
+    uint32_t ipi = 1500;            // per interrupted core: the handler invalidating its tlbs
+
+    // set the field called name, false if there is none
+    bool set(const string& name, uint32_t cycles);
+};
+
+// counters of one breakdown bucket
+struct AccessCounters {
+    uint64_t accesses = 0;
+    uint64_t l1_hit = 0;
+    uint64_t l2_hit = 0;
+    uint64_t tlb_miss = 0;
+    uint64_t walk_refs = 0;
+    uint64_t page_faults = 0;
+    uint64_t invalid_accesses = 0;
+    uint64_t cache_hit = 0;
+    uint64_t cache_miss = 0;
+    uint64_t cycles[COST_COUNT] = {};
+
+    AccessCounters& operator+=(const AccessCounters& other);
+    uint64_t totalCycles() const;
+    // average memory access time in cycles
+    double amat() const;
+};
+
+// TLB level that satisfied an access (mirrors TlbHitLevel)
+enum StatsLevel {
+    STATS_MISS,
+    STATS_L1,
+    STATS_L2
+};
+
+// outcome of one access, as seen by os::accessMemory()
+struct AccessRecord {
+    uint32_t pid;
+    uint32_t core;
+    Segment segment;
+    StatsLevel level;
+    uint32_t pageSize;      // 0 when the walk failed
+    uint32_t walkRefs;
+    bool pageFault;
+    bool invalid;
+    int cacheResult;        // 1 hit, 0 miss, -1 not cached
+    uint64_t cycles[COST_COUNT];
+};
+
+// one process's slice of a dynamically partitioned l2 tlb at the end of a repartitioning epoch
+struct L2ShareSample {
+    uint64_t time;          // l2 lookups since the start of the run
+    uint32_t pid;
+    uint32_t quota;         // entries granted for the next epoch
+    uint32_t occupancy;     // entries held at the end of the epoch
+    uint32_t capacity;      // l2 entries in total, share = occupancy / capacity
+    uint64_t lookups;       // l2 lookups of the process during the epoch
+    uint64_t hits;
+};
+
+// data accesses and migrations of one memory tier
+struct TierCounters {
+    string name;
+    uint64_t accesses = 0;          // data accesses served by the tier (not by the page cache)
+    uint64_t promoted_in = 0;       // pages moved up into the tier
+    uint64_t demoted_in = 0;        // pages moved down into the tier
+    uint64_t migrated_bytes = 0;    // bytes copied into the tier
+};
+
+struct SimStats {
+    // totals
+    uint64_t L1_hit = 0;
+    uint64_t L2_hit = 0;
+    uint64_t TLB_miss = 0;
+    uint64_t memory_hit = 0;               // page table memory references (walk_pde_refs + walk_pte_refs)
+    uint64_t memory_access_attempts = 0;
+    uint64_t page_faults = 0;
+    uint64_t invalid_accesses = 0;
+    uint64_t cache_hit = 0;
+    uint64_t cache_miss = 0;
+    uint64_t context_switches = 0;
+    uint64_t l1_flushes = 0;
+    uint64_t page_walks = 0;          // demand and prefetch walks
+    uint64_t pde_cache_hits = 0;      // walks whose directory level was served by the page-walk cache
+    uint64_t walk_pde_refs = 0;       // directory reads
+    uint64_t walk_pte_refs = 0;       // PTE reads
+    uint64_t prefetch_issued = 0;     // translations installed by the tlb prefetcher
+    uint64_t prefetch_useful = 0;     // of those, demanded before being evicted
+    uint64_t prefetch_walks = 0;      // page walks made for prefetching (also in memory_hit)
+    uint64_t swap_outs = 0;           // pages written to swap
+    uint64_t swap_ins = 0;            // pages read back from swap on a fault (also page faults)
+    uint64_t direct_reclaims = 0;     // stalls of the allocating process in synchronous reclaim
+    uint64_t direct_reclaim_pages = 0;// 4KB pages swapped out by them
+    uint64_t kswapd_wakeups = 0;      // background reclaim runs
+    uint64_t kswapd_pages = 0;        // 4KB pages swapped out in the background
+    uint64_t reclaim_scanned = 0;     // resident pages looked at by reclaim
+    uint64_t reclaim_referenced = 0;  // of those, found referenced and kept
+    uint64_t thp_scans = 0;           // khugepaged passes
+    uint64_t thp_promotions = 0;      // regions collapsed into a huge page
+    uint64_t thp_promote_failed = 0;  // collapses abandoned for lack of a free huge frame
+    uint64_t thp_copied_pages = 0;    // 4KB pages copied by collapses
+    uint64_t thp_demotions = 0;       // huge pages split into 4KB mappings
+    uint64_t thp_reclaimed_pages = 0; // 4KB frames given back by splits
+    uint64_t thp_refaults = 0;        // zero-fill faults on reclaimed pages (also page faults)
+    uint64_t migration_passes = 0;    // tier migration passes
+    uint64_t migration_promotions = 0;// pages moved to a faster tier
+    uint64_t migration_demotions = 0; // pages moved to a slower tier
+    uint64_t migration_bytes = 0;     // bytes copied between tiers
+    uint64_t tlb_shootdowns = 0;      // shootdown rounds that interrupted at least one other core
+    uint64_t shootdown_ipis = 0;      // cores interrupted by them
+    uint64_t shootdown_invalidations = 0; // translations invalidated on other cores
+    uint64_t cycles[COST_COUNT] = {}; // the only totals record() and charge() maintain
+
+    // breakdowns
+    AccessCounters segments[SEG_COUNT];
+    map<uint32_t, AccessCounters> processes;   // by pid
+    map<uint32_t, AccessCounters> cores;       // by simulated core
+    map<uint32_t, AccessCounters> pageSizes;   // by page size in bytes
+    vector<L2ShareSample> l2Shares;            // filled by utility-based l2 partitioning
+    vector<TierCounters> tiers;                // fastest first, one entry per memory tier
+
+    // add one access to every breakdown it belongs to; totals are kept by their owners,
+    // except for the cycles which are added to the totals here
+    void record(const AccessRecord& access);
+    // cycles not tied to one access (swap writes on reclaim): charged to the process, the core
+    // it ran on and the totals, not to a segment or page size
+    void charge(uint32_t pid, uint32_t core, CostComponent component, uint64_t cycles);
+    // add the counters of other (the stats of one core) to these; tiers are matched by index
+    SimStats& operator+=(const SimStats& other);
+
+    uint64_t totalCycles() const;
+    double amat() const;
+
+    // TLB misses of one segment (the old stack_miss / heap_miss / code_miss)
+    uint64_t segmentMisses(Segment segment) const { return segments[segment].tlb_miss; }
+
+    // prefetch accuracy = useful / issued, coverage = useful / (useful + remaining tlb misses)
+    double prefetchAccuracy() const;
+    double prefetchCoverage() const;
+    // page table references per walk and per access (the walk cost a TLB miss adds on average)
+    double walkRefsPerWalk() const;
+    double walkRefsPerAccess() const;
+    // share of the data accesses that went to memory and were served by the fastest tier
+    double fastTierFraction() const;
+
+    // one JSON object: totals, "events", "prefetch", "walks", "cycles", "reclaim", "thp", "tiers",
+    // "shootdowns", "segments", "processes", "cores", "page_sizes", "l2_shares"
+    void writeJson(ostream& out) const;
+    // header plus one row per bucket: scope,key,<AccessCounters fields>,cycles,amat
+    // the totals are the row with scope "total"; counters that are not per access
+    // (context switches, flushes, prefetches, walks, reclaim, thp, migrations, shootdowns) are "event" rows with the count in the
+    // accesses column; each memory tier is a "tier" row with its data accesses
+    void writeCsv(ostream& out) const;
+    // time,pid,quota,occupancy,share,lookups,hits,hit_rate per sample
+    void writeL2SharesCsv(ostream& out) const;
+};
+
+#endif // STATS_H
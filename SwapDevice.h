@@ -0,0 +1,56 @@
+// SwapDevice.h
+
+#ifndef SWAP_DEVICE_H
+#define SWAP_DEVICE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * Swap space backed by a file. The device is split into 4KB slots; a page of
+ * any size occupies a run of contiguous slots, addressed by its first one.
+ * Slots are tracked in a bitmap, allocated next fit.
+ * The file is created on the first write, in its own unlinked temporary file so
+ * concurrent simulations never share one, and disappears with the device.
+ */
+
+const size_t SWAP_SLOT_SIZE = 4096;
+const uint32_t NO_SLOT = UINT32_MAX;
+
+class SwapDevice {
+private:
+    string directory;
+    int fd = -1;
+    size_t slots;
+    size_t freeCount;
+    vector<uint64_t> bitmap;    // one bit per slot, set when used
+    size_t hint = 0;            // next-fit cursor
+
+    bool used(size_t slot) const { return bitmap[slot / 64] >> (slot % 64) & 1; }
+    void mark(uint32_t slot, uint32_t count, bool used);
+    void open();
+
+public:
+    // size bytes of swap in a file under directory (empty: $TMPDIR or /tmp)
+    SwapDevice(size_t size, const string& directory);
+    ~SwapDevice();
+    SwapDevice(const SwapDevice&) = delete;
+    SwapDevice& operator=(const SwapDevice&) = delete;
+
+    // first of count contiguous free slots, marked used, NO_SLOT if there is no such run
+    uint32_t allocate(uint32_t count);
+    void free(uint32_t slot, uint32_t count);
+
+    // bytes at slot, throws runtime_error when the I/O fails
+    void write(uint32_t slot, const void* data, size_t bytes);
+    void read(uint32_t slot, void* data, size_t bytes);
+
+    size_t slotCount() const { return slots; }
+    size_t freeSlots() const { return freeCount; }
+};
+
+#endif // SWAP_DEVICE_H
@@ -0,0 +1,61 @@
+// ThreadPool.h
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+using namespace std;
+
+/**
+ * Work-stealing thread pool for independent simulations.
+ * Every worker owns a deque: it pops its own tasks from the back and, when it
+ * runs dry, steals from the front of the other workers' deques, so one long
+ * trace does not leave the rest of the pool idle behind it.
+ * Tasks submitted from outside the pool are spread round-robin over the deques.
+ */
+class ThreadPool {
+private:
+    struct WorkerQueue {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+
+    vector<unique_ptr<WorkerQueue>> queues;
+    vector<thread> workers;
+    mutex stateLock;
+    condition_variable workAvailable;
+    condition_variable allDone;
+    size_t queued = 0;        // tasks sitting in a deque
+    size_t pending = 0;       // tasks submitted and not finished
+    size_t nextQueue = 0;     // round-robin target for outside submissions
+    bool stopping = false;
+    exception_ptr firstError;
+
+    bool popTask(size_t self, function<void()>& task);
+    void workerLoop(size_t self);
+
+public:
+    // numThreads == 0 uses one thread per hardware thread
+    explicit ThreadPool(size_t numThreads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(function<void()> task);
+
+    // block until every submitted task has finished
+    // rethrows the first exception a task let escape
+    void wait();
+
+    size_t size() const { return workers.size(); }
+};
+
+#endif // THREAD_POOL_H
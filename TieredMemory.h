@@ -0,0 +1,79 @@
+// TieredMemory.h
+
+#ifndef TIERED_MEMORY_H
+#define TIERED_MEMORY_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "BuddyAllocator.h"
+
+using namespace std;
+
+/**
+ * Physical memory made of several tiers, fastest first (DRAM, then a slower
+ * capacity tier). The tiers share one pfn space (20 bits in the 32-bit address mode, 31 in
+ * the 64-bit ones): tier i owns the frames
+ * right after tier i - 1, each managed by its own buddy allocator. New blocks are
+ * placed by a first-touch policy; the os migrates pages between tiers afterwards.
+ */
+
+struct MemoryTierConfig {
+    string name;
+    size_t capacity;        // bytes
+    uint32_t latency;       // cycles of a data access served by the tier
+    double bandwidth;       // bytes per cycle, bounds the cost of migrating pages in or out
+};
+
+// where a new block goes when its preferred tier is full, the next one in the order is tried
+enum PlacementPolicy {
+    PLACE_FAST_FIRST,       // fastest tier with room
+    PLACE_SLOW_FIRST,       // slowest tier first, pages have to earn promotion
+    PLACE_INTERLEAVE        // round robin over the tiers, one block at a time
+};
+
+// tiers plus the migration policy the os runs on top of them
+struct TieringConfig {
+    vector<MemoryTierConfig> tiers;   // empty: one tier holding all memory at the cost model's
+                                      // memory latency
+    PlacementPolicy placement = PLACE_FAST_FIRST;
+    uint32_t migrateInterval = 0;     // accesses between two migration passes, 0 = never migrate
+    uint32_t sampleInterval = 1;      // count one access in sampleInterval towards page heat
+    uint32_t hotThreshold = 8;        // sampled accesses (decayed) that make a page hot
+    uint32_t coldThreshold = 1;       // at most this many and the page is cold
+    uint32_t maxMigrations = 256;     // pages moved per pass, promotions and demotions together
+};
+
+class TieredMemory {
+private:
+    vector<MemoryTierConfig> tiers;
+    vector<BuddyAllocator> allocators;
+    PlacementPolicy placement;
+    size_t nextTier = 0;              // interleave cursor
+
+public:
+    // throws invalid_argument when the tiers do not fit pfnBits-bit pfns
+    TieredMemory(const vector<MemoryTierConfig>& tiers, PlacementPolicy placement, int pfnBits = 20);
+
+    // block of 2^order frames placed by the policy, NO_FRAME if no tier has one
+    uint32_t allocate(int order);
+    // block of 2^order frames in tier, NO_FRAME if it has none
+    uint32_t allocateIn(int order, size_t tier);
+
+    // same contract as BuddyAllocator, for a pfn of any tier
+    void free(uint32_t pfn);
+    void split(uint32_t pfn);
+    bool isAllocated(uint32_t pfn) const;
+    int blockOrder(uint32_t pfn) const;
+    uint32_t peekFree() const;
+    size_t freeBytes() const;
+    size_t freeBytes(size_t tier) const;
+
+    // tier owning pfn (tierCount() for a pfn outside every tier)
+    size_t tierOf(uint32_t pfn) const;
+    size_t tierCount() const { return tiers.size(); }
+    const MemoryTierConfig& tier(size_t index) const { return tiers[index]; }
+};
+
+#endif // TIERED_MEMORY_H
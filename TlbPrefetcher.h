@@ -0,0 +1,93 @@
+// TlbPrefetcher.h
+#ifndef TLB_PREFETCHER_H
+#define TLB_PREFETCHER_H
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+
+using namespace std;
+
+// Which prefetcher runs on the tlb miss path, see the classes below.
+enum TlbPrefetchKind {
+  TLB_PREFETCH_NONE,
+  TLB_PREFETCH_SEQUENTIAL,
+  TLB_PREFETCH_STRIDE,
+  TLB_PREFETCH_DISTANCE
+};
+
+// TLB prefetch engines. On every demand miss (after the walk) the os asks the engine for
+// candidate 4KB page numbers, walks the ones that are not cached yet and installs them in
+// l2 or the prefetch buffer (Tlb::prefetch_fill). There is no program counter in the traces,
+// so all state is kept per process.
+class TlbPrefetcher {
+public:
+  virtual ~TlbPrefetcher() {}
+  // miss_vpn: 4KB page of the missing address
+  // page_vpn / page_pages: first 4KB page and length (in 4KB pages) of the mapping it hit
+  // candidates is cleared and filled with the pages to prefetch
+  virtual void on_miss(uint32_t process_id, uint64_t miss_vpn, uint64_t page_vpn, uint32_t page_pages,
+                       vector<uint64_t>& candidates) = 0;
+};
+
+// next-page: the mappings right after the missing one, assuming neighbours of the same size
+class SequentialPrefetcher : public TlbPrefetcher {
+public:
+  SequentialPrefetcher(uint32_t degree) : degree(degree) {}
+  void on_miss(uint32_t process_id, uint64_t miss_vpn, uint64_t page_vpn, uint32_t page_pages,
+               vector<uint64_t>& candidates) override;
+
+private:
+  uint32_t degree;
+};
+
+// stride: once two consecutive misses of a process are the same distance apart,
+// prefetch degree more pages along that stride
+class StridePrefetcher : public TlbPrefetcher {
+public:
+  StridePrefetcher(uint32_t degree) : degree(degree) {}
+  void on_miss(uint32_t process_id, uint64_t miss_vpn, uint64_t page_vpn, uint32_t page_pages,
+               vector<uint64_t>& candidates) override;
+
+private:
+  struct History {
+    uint64_t last_vpn = 0;
+    int64_t last_stride = 0;
+    bool primed = false;
+  };
+  uint32_t degree;
+  unordered_map<uint32_t, History> history;   // by pid
+};
+
+// distance prefetching (Kandiraju & Sivasubramaniam): a table indexed by the distance between
+// the last two misses remembers which distances followed it before; those are prefetched
+// relative to the current miss. Direct mapped, 2 successors per row, most recent first.
+class DistancePrefetcher : public TlbPrefetcher {
+public:
+  DistancePrefetcher(uint32_t degree, uint32_t rows = 256);
+  void on_miss(uint32_t process_id, uint64_t miss_vpn, uint64_t page_vpn, uint32_t page_pages,
+               vector<uint64_t>& candidates) override;
+
+private:
+  struct Row {
+    int64_t distance = 0;      // tag
+    bool valid = false;
+    int64_t next[2] = {0, 0};
+    uint32_t count = 0;        // successors recorded, at most 2
+  };
+  struct History {
+    uint64_t last_vpn = 0;
+    int64_t last_distance = 0;
+    uint32_t misses = 0;
+  };
+  uint32_t degree;
+  vector<Row> table;
+  unordered_map<uint32_t, History> history;   // by pid
+
+  Row& row(int64_t distance);
+};
+
+// nullptr for TLB_PREFETCH_NONE
+TlbPrefetcher* make_tlb_prefetcher(TlbPrefetchKind kind, uint32_t degree);
+
+#endif
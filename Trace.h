@@ -0,0 +1,118 @@
+// Trace.h
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <string>
+
+using namespace std;
+
+/**
+ * Trace input for the simulator.
+ * Text traces are the "pid instruction value" lines produced by test_generator.py,
+ * optionally followed by the (decimal) core the record runs on for multi-core traces.
+ * Binary traces are a TraceHeader followed by fixed-width TraceRecords in host
+ * byte order; they are replayed straight out of an mmap'ed file.
+ * TraceReader detects the format from the header magic.
+ * Values are 64-bit since version 2 of the binary format (64-bit address modes); version 1
+ * traces, with 32-bit values, are still read and widened record by record.
+ */
+
+enum Opcode : uint16_t {
+    OP_ALLOC,
+    OP_FREE,
+    OP_ACCESS_STACK,
+    OP_ACCESS_HEAP,
+    OP_ACCESS_CODE,
+    OP_SWITCH,
+    OP_INVALID
+};
+
+struct TraceRecord {
+    uint32_t pid;
+    uint16_t opcode;
+    uint16_t core;          // 1 + the core the record runs on, 0 when untagged
+    uint64_t value;         // address or size
+};
+static_assert(sizeof(TraceRecord) == 16, "TraceRecord must stay 16 bytes");
+
+// record of a version 1 binary trace
+struct TraceRecordV1 {
+    uint32_t pid;
+    uint16_t opcode;
+    uint16_t core;
+    uint32_t value;
+};
+static_assert(sizeof(TraceRecordV1) == 12, "TraceRecordV1 must stay 12 bytes");
+
+const char TRACE_MAGIC[8] = {'F', 'T', 'M', 'T', 'R', 'A', 'C', 'E'};
+const uint32_t TRACE_VERSION = 2;
+
+struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t recordCount;
+};
+static_assert(sizeof(TraceHeader) == 24, "TraceHeader must stay 24 bytes");
+
+// instruction name as written in text traces <-> opcode
+Opcode opcodeFromName(const string& name);
+const char* opcodeName(Opcode opcode);
+
+class TraceReader {
+private:
+    // binary traces
+    int fd;
+    void* mapping;
+    size_t mappingSize;
+    const TraceRecord* records;
+    const TraceRecordV1* legacyRecords;    // version 1 traces, records is nullptr then
+    size_t recordCount;
+    size_t position;
+    // text traces
+    ifstream text;
+    string line;
+    TraceRecord current;
+
+    bool openBinary(const char* path);
+    const TraceRecord* nextText();
+    const TraceRecord* widen(const TraceRecordV1& record) {
+        current.pid = record.pid;
+        current.opcode = record.opcode;
+        current.core = record.core;
+        current.value = record.value;
+        return &current;
+    }
+
+public:
+    // throws runtime_error when the file cannot be opened or has a bad binary header
+    TraceReader(const char* path);
+    ~TraceReader();
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+
+    // next record, nullptr at the end of the trace
+    // binary records point into the mapping, text and version 1 records into a buffer reused
+    // by the next call
+    const TraceRecord* next() {
+        if (records) {
+            return position < recordCount ? &records[position++] : nullptr;
+        }
+        if (legacyRecords) {
+            return position < recordCount ? widen(legacyRecords[position++]) : nullptr;
+        }
+        return nextText();
+    }
+
+    bool isBinary() const { return mapping != nullptr; }
+};
+
+// convert a text trace to the (current version of the) binary format, return the number of
+// records written
+size_t convertTextTrace(const char* textPath, const char* binaryPath);
+
+#endif // TRACE_H
@@ -5,50 +5,89 @@
 
 #include <iostream>
 #include <vector>
+#include <array>
+#include <memory>
 #include <cstdint>
 #include <map>
+#include "PageTable.h"
+#include "PageSpan.h"
 
 using namespace std;
 
 /**
  * Create a two-level page table for a process, given the PID.
  * Given page size, vpn, and pfn, set a mapping from virtual page to physical frame.
- * Given a vpn, translate it to a pfn, return pte.
+ * Given a vpn, translate it to a pfn, return pte and a walk status.
  * Physical memory 32bit
- * Address space 32bit
+ * Address space 32bit, the table of the 32-bit address mode (see PageTable.h)
  * page size from 4KB to 1GB
+ *
+ * Layout is a real radix tree: a 1024-entry page directory whose slots point to
+ * 1024-entry PTE pages. PTE pages are allocated lazily by setMapping() and
+ * released once their last mapping is freed, so the table only costs memory
+ * for the parts of the address space that are mapped.
+ *
+ * Pages are never replicated per 4KB:
+ *  - a page of 4MB or more that starts on a directory boundary is a leaf PDE, one per
+ *    4MB directory slot it covers, and has no PTE page (x86 PSE style);
+ *  - every other page is a span in the PTE pages it touches (see PageSpan.h).
+ * Map, unmap and swap out touch one entry per piece, so a huge page costs O(1)
+ * (at most one piece per 4MB) instead of one entry per 4KB.
  */
 
-extern int memory_hit;
+// In-table PTE or leaf PDE: 4 bytes, encoded by SpanEntry<uint32_t>.
+typedef uint32_t PackedPTE;
 
-struct PTE {
-    uint32_t vpn;
-    uint32_t pfn;
-    uint32_t page_size;
-    bool present;
-    bool valid;
-    PTE(uint32_t vpn, uint32_t pfn, uint32_t page_size);
-    PTE();
-};
+// One second-level table: 1024 packed PTEs and their start bitmap, cache-line aligned.
+struct alignas(64) PTEPage : SpanPage<PackedPTE, 1024> {};
 
 
-class TwoLevelPageTable {
+class TwoLevelPageTable : public PageTable {
 private:
     uint32_t pid;
     int physMemBits = 32;
     int virtualMemBits = 32;
     int pfnBits = physMemBits - 12;
-    map<uint32_t, map<uint32_t, PTE>> mapToPDEs;
+    array<unique_ptr<PTEPage>, 1024> directory;   // nullptr = no PTE page (maybe a leaf)
+    array<PackedPTE, 1024> leaves{};              // leaf PDEs of pages >= 4MB, 0 = none
+    array<uint16_t, 1024> liveEntries{};          // 4KB slots covered by spans in each PTE page
+    uint32_t ptePages = 0;
+    typedef SpanEntry<PackedPTE> Encoding;
+
+    // the entry mapping vpn, rebased to vpn's own slot, 0 if unmapped (or outside 32 bits)
+    PackedPTE lookup(uint64_t vpn) const;
+    // unmap every page overlapping [vpn, vpn + numPages)
+    void unmapOverlapping(uint32_t vpn, uint32_t numPages);
+    // remove the page starting at pageVpn, given its length in 4KB pages
+    void unmapPage(uint32_t pageVpn, uint32_t numPages);
+    // entry of the first piece of the page mapping vpn, nullptr if unmapped
+    PackedPTE* firstPieceEntry(uint64_t vpn);
 
 public:
     TwoLevelPageTable(int pidGiven);
 
-    void setMapping(uint32_t pageSize, uint32_t vpn, uint32_t pfn);
+    void setMapping(uint32_t pageSize, uint64_t vpn, uint32_t pfn) override;
+
+    // a walk reads the directory slot and, if it points to a PTE page, one PTE
+    WalkStatus translate(uint64_t vaddr, PTE& pte) const override;
+
+    uint32_t directoryReads(uint64_t vaddr) const override { return 1; }
+    // false for an empty slot or a leaf PDE (whose walk ends at the directory)
+    bool hasPTEPage(uint64_t vaddr) const override {
+        return vaddr >> virtualMemBits == 0 && directory[vaddr >> 22] != nullptr;
+    }
+
+    void free(uint64_t vpn) override;
+    void updatePresentBit(uint64_t vpn) override;
+
+    void markAccessed(uint64_t vpn) override;
+    bool testAndClearAccessed(uint64_t vpn) override;
 
-    PTE translate(uint32_t vpn);
+    // bytes used by the directory (PTE page pointers and leaves) plus every allocated PTE page
+    size_t footprintBytes() const override;
 
-    void free(uint32_t vpn);
-    void updatePresentBit(uint32_t vpn);
+    int addressBits() const override { return virtualMemBits; }
+    int pteIndexBits() const override { return 10; }
 };
 
 #endif // TWO_LEVEL_PAGE_TABLE_H
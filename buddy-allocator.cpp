@@ -0,0 +1,134 @@
+#include <cstdint>
+#include <stdexcept>
+#include "BuddyAllocator.h"
+
+using namespace std;
+
+const size_t frameSize = 4096;
+
+// 1. constructor
+//    carve the frame range into the largest aligned blocks that fit
+BuddyAllocator::BuddyAllocator(size_t numFrames, uint32_t firstPfn)
+    : firstPfn(firstPfn), numFrames(numFrames), freeFrameCount(0),
+      next(numFrames, NO_FRAME), prev(numFrames, NO_FRAME),
+      freeOrder(numFrames, -1), allocOrder(numFrames, -1) {
+    for (int order = 0; order <= BUDDY_MAX_ORDER; order++) {
+        freeHead[order] = NO_FRAME;
+    }
+    size_t end = firstPfn + numFrames;
+    size_t pfn = firstPfn;
+    while (pfn < end) {
+        int order = BUDDY_MAX_ORDER;
+        while (order > 0 && (pfn % (1u << order) != 0 || pfn + (1u << order) > end)) {
+            order--;
+        }
+        pushFree(pfn, order);
+        freeFrameCount += 1u << order;
+        pfn += 1u << order;
+    }
+}
+
+void BuddyAllocator::pushFree(uint32_t pfn, int order) {
+    freeOrder[index(pfn)] = order;
+    prev[index(pfn)] = NO_FRAME;
+    next[index(pfn)] = freeHead[order];
+    if (freeHead[order] != NO_FRAME) {
+        prev[index(freeHead[order])] = pfn;
+    }
+    freeHead[order] = pfn;
+}
+
+void BuddyAllocator::unlinkFree(uint32_t pfn, int order) {
+    size_t i = index(pfn);
+    if (prev[i] != NO_FRAME) {
+        next[index(prev[i])] = next[i];
+    } else {
+        freeHead[order] = next[i];
+    }
+    if (next[i] != NO_FRAME) {
+        prev[index(next[i])] = prev[i];
+    }
+    freeOrder[i] = -1;
+}
+
+// 2. allocate
+//    take the smallest free block that fits and split it down to the requested order
+uint32_t BuddyAllocator::allocate(int order) {
+    if (order < 0 || order > BUDDY_MAX_ORDER) {
+        return NO_FRAME;
+    }
+    int found = order;
+    while (found <= BUDDY_MAX_ORDER && freeHead[found] == NO_FRAME) {
+        found++;
+    }
+    if (found > BUDDY_MAX_ORDER) {
+        return NO_FRAME;
+    }
+    uint32_t pfn = freeHead[found];
+    unlinkFree(pfn, found);
+    while (found > order) {
+        found--;
+        pushFree(pfn + (1u << found), found);   // upper half goes back as a free buddy
+    }
+    allocOrder[index(pfn)] = order;
+    freeFrameCount -= 1u << order;
+    return pfn;
+}
+
+// 3. free
+//    coalesce with the buddy as long as it is free and of the same order
+void BuddyAllocator::free(uint32_t pfn) {
+    if (!isAllocated(pfn)) {
+        throw logic_error("Freeing a frame that is not the start of an allocated block");
+    }
+    int order = allocOrder[index(pfn)];
+    allocOrder[index(pfn)] = -1;
+    freeFrameCount += 1u << order;
+
+    while (order < BUDDY_MAX_ORDER) {
+        uint32_t buddy = pfn ^ (1u << order);
+        if (buddy < firstPfn || buddy >= firstPfn + numFrames || freeOrder[index(buddy)] != order) {
+            break;
+        }
+        unlinkFree(buddy, order);
+        pfn &= ~(1u << order);
+        order++;
+    }
+    pushFree(pfn, order);
+}
+
+// 4. split
+void BuddyAllocator::split(uint32_t pfn) {
+    if (!isAllocated(pfn)) {
+        throw logic_error("Splitting a frame that is not the start of an allocated block");
+    }
+    uint32_t frames = 1u << allocOrder[index(pfn)];
+    for (uint32_t i = 0; i < frames; i++) {
+        allocOrder[index(pfn) + i] = 0;
+    }
+}
+
+bool BuddyAllocator::contains(uint32_t pfn) const {
+    return pfn >= firstPfn && pfn - firstPfn < numFrames;
+}
+
+bool BuddyAllocator::isAllocated(uint32_t pfn) const {
+    return contains(pfn) && allocOrder[index(pfn)] >= 0;
+}
+
+int BuddyAllocator::blockOrder(uint32_t pfn) const {
+    return contains(pfn) ? allocOrder[index(pfn)] : -1;
+}
+
+uint32_t BuddyAllocator::peekFree() const {
+    for (int order = 0; order <= BUDDY_MAX_ORDER; order++) {
+        if (freeHead[order] != NO_FRAME) {
+            return freeHead[order];
+        }
+    }
+    return NO_FRAME;
+}
+
+size_t BuddyAllocator::freeBytes() const {
+    return freeFrameCount * frameSize;
+}
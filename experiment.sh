@@ -1,10 +1,3 @@
-for file in "test_cases"/*; do
-    if [ -f "$file" ]; then
-        filename=$(basename -- "$file")
-        echo $filename
-        
-        ./a.out "test_cases/$filename" >> "results/fifo.txt"
-        
-        echo ""
-    fi
-done
+# Replay every trace in test_cases with both caching strategies in one process,
+# simulations run concurrently, one CSV line per run.
+./a.out --sweep --cache-choice=0,1 test_cases --output=results/sweep.csv "$@"
@@ -1,77 +1,761 @@
 #include "os.h"
 #include "tlb.h"
-#include "TwoLevelPageTable.h"
+#include "PageTable.h"
+#include "Trace.h"
+#include "Simulation.h"
 #include <stdint.h>
 #include <fstream>
 #include <sstream>
+#include <cstdlib>
+#include <algorithm>
+#include <filesystem>
 
-int main(int argc, char *argv[]) {
-    size_t memorySize = 1ULL << 32; 
-    size_t diskSize = 1024 * 1024 * 1024 * 10; 
-    uint32_t high_watermark = 200 * 1024 * 1024;
-    uint32_t low_watermark = 100 * 1024 * 1024;
+// Options are given as --name=value, every argument that is not an option is a trace file
+// (or a directory of traces). Text and binary traces are both accepted, the format is
+// detected from the file header.
+//   --convert=OUT                write the text trace as a binary trace to OUT and exit
+//   --cache-choice=0|1           1 caches huge pages, 0 subpages (prompted when not given)
+//   --seed=N                     random replacement seed, 0 = seed from the clock (default)
+// TLB geometry:
+//   --l1-size=N --l2-size=N      number of entries (default 64 / 1024)
+//   --l1-ways=N --l2-ways=N      associativity, 0 = fully associative (default)
+//   --tlb-hash=mod|xor           set index function for set-associative levels
+//   --l1-policy=P --l2-policy=P  replacement: random|fifo|lru|clock|srrip (default fifo)
+//   --l2-partition=static|ucp    fixed per-process l2 partitions (default) or one shared l2 with
+//                                utility-based quotas
+//   --ucp-epoch=N                l2 lookups between two repartitionings (default 4096)
+//   --asid-bits=N                tag l1 entries with N-bit asids instead of flushing l1 on every
+//                                switch, 0 = flush (default)
+// Page-walk cache (caches page directory entries, a hit saves the directory read of a walk):
+//   --pde-cache=N                entries, 0 = none (default)
+//   --pde-cache-ways=N           associativity, 0 = fully associative (default)
+//   --pde-cache-policy=P         replacement, as for the tlb levels (default lru)
+// TLB prefetching (on the miss path, after the demand walk):
+//   --prefetch=P                 none|sequential|stride|distance (default none)
+//   --prefetch-degree=N          candidates per miss (default 1)
+//   --prefetch-buffer=N          entries of a separate prefetch buffer looked up next to l2,
+//                                0 = prefetch straight into l2 (default)
+// Page cache:
+//   --cache-policy=lfu|lru|arc   replacement policy (default lfu)
+//   --cache-size=N               capacity in entries (default 512)
+// Transparent huge pages (khugepaged-like promotion and demotion, see ThpConfig):
+//   --thp=off|on                 (default off)
+//   --thp-promote=F              share of a region's 4KB pages touched in a scan interval that
+//                                collapses it into a huge page (default 0.75)
+//   --thp-demote=F               share of a huge page's subpages touched below which it is
+//                                split (default 0.125)
+//   --thp-demote-scans=N         consecutive sparse scans before a split (default 2)
+//   --thp-scan-interval=N        accesses between two scans (default 65536)
+// Physical memory and swap (memory can be overcommitted: pages are swapped out on demand
+// and read back from a swap file on fault):
+//   --memory=MB                  physical memory, at most 4096 with 32-bit addresses and 8388608
+//                                with 48 or 57-bit ones (default 4096)
+//   --swap-size=MB               swap device size (default 10240)
+//   --swap-dir=DIR               directory of the swap files, one unlinked file per run
+//                                (default $TMPDIR or /tmp)
+//   --low-watermark=MB           reclaim starts below this much free memory (default 1/40 of memory)
+//   --high-watermark=MB          and stops above this much (default 1/20 of memory)
+//   --kswapd=off|on              reclaim in a background thread instead of in the allocating
+//                                process (see ReclaimConfig, default off)
+//   --kswapd-batch=N             pages kswapd swaps out between two looks at the replay (default 32)
+//   --reclaim-policy=P           victim selection: address|clock|clock2|wsclock|lru (default clock)
+//   --reclaim-scope=S            global: victims from every process, local: from the process
+//                                asking for memory first (default global)
+//   --hand-spread=N              pages between the hands of clock2 (default 256)
+//   --ws-window=N                accesses of its process after which an unreferenced page leaves
+//                                the working set, for wsclock (default 65536)
+// Address space (see PageTable.h):
+//   --address-bits=32|48|57      virtual address width: 32 uses two-level page tables (10/10/12),
+//                                48 and 57 use 4 and 5-level radix page tables with 2MB and 1GB
+//                                leaves; trace values are 64-bit either way (default 32)
+// Tiered memory (hot/cold page migration between tiers, see TieringConfig):
+//   --tiers=NAME:MB:LAT:BW,...   memory tiers, fastest first: capacity in MB, data access latency
+//                                in cycles, copy bandwidth in bytes per cycle
+//                                (default: one tier of all memory at the cache_miss latency)
+//   --placement=P                first touch placement: fast|slow|interleave (default fast)
+//   --migrate-interval=N         accesses between two migration passes, 0 = off (default)
+//   --migrate-sample=N           sample one access in N into the page heat (default 1)
+//   --hot-threshold=N            sampled accesses that make a page hot (default 8)
+//   --cold-threshold=N           at most this many and the page is cold (default 1)
+//   --migrate-max=N              pages moved per pass (default 256)
+// Multi-core (see Core in os.h):
+//   --cores=N                    simulated cpus, each with its own tlbs, at most 64 (default 1);
+//                                trace records may name their core, otherwise switches are
+//                                scheduled onto the cores
+//   --parallel=off|on            replay every core on a host thread of its own; the records of
+//                                different cores interleave differently from run to run, and
+//                                stack distances are not available. Untagged processes are
+//                                pinned to the core they first run on instead of being
+//                                rescheduled round robin (default off)
+// Cost model (cycles, reported as total cycles and AMAT per component and process):
+//   --latency=NAME=N,...         override event latencies: l1_tlb, l2_tlb, walk_pde, walk_pte,
+//                                cache_hit, cache_miss, page_fault, swap_read, swap_write,
+//                                shootdown (per round, on the initiator), ipi (per interrupted core)
+//                                (swap costs are per 4KB page)
+// Sweeps:
+//   Grid options take comma separated lists (--l1-size=32,64,128). Every combination is run
+//   against every trace; with more than one run (or --sweep) the simulations run concurrently
+//   and one CSV line is printed per run.
+//   --sweep                      CSV output even for a single run
+//   --threads=N                  worker threads (default: one per hardware thread)
+//   --output=FILE                write the CSV to FILE instead of stdout
+// Statistics export (totals plus per segment / process / page size breakdowns):
+//   --stats-json=FILE            JSON (an array with one object per run when sweeping)
+//   --stats-csv=FILE             CSV, single runs only
+// L2 partitioning (single runs only):
+//   --l2-shares=FILE             per-process l2 quota, share and hit rate per epoch (ucp), as CSV
+// Stack-distance analysis (single runs only):
+//   --stack-distance=FILE        LRU hit rate vs capacity of l1, l2 and the page cache, as CSV,
+//                                computed in the same pass for every capacity (one core only)
+static bool parseOption(const string& arg, const string& name, string& value) {
+    string prefix = "--" + name + "=";
+    if (arg.compare(0, prefix.size(), prefix) != 0) {
+        return false;
+    }
+    value = arg.substr(prefix.size());
+    return true;
+}
 
-    bool cacheChoice = false; // Default strategy
+static vector<string> splitList(const string& value) {
+    vector<string> items;
+    stringstream ss(value);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
 
-    std::cout << "Choose caching strategy (1 for Huge Pages, 0 for Subpages): ";
-    std::cin >> cacheChoice;
+static vector<uint32_t> parseNumberList(const string& value) {
+    vector<uint32_t> numbers;
+    for (const string& item : splitList(value)) {
+        numbers.push_back(strtoul(item.c_str(), nullptr, 0));
+    }
+    return numbers;
+}
 
-    os osInstance(memorySize, diskSize, high_watermark, low_watermark, cacheChoice);
-    
-    ifstream inputFile(argv[1]);
-    if (!inputFile) {
-        cerr << "Error: Unable to open file." << endl;
+static vector<double> parseDoubleList(const string& value) {
+    vector<double> numbers;
+    for (const string& item : splitList(value)) {
+        numbers.push_back(strtod(item.c_str(), nullptr));
+    }
+    return numbers;
+}
+
+static bool parseTlbReplacement(const string& name, TlbReplacement& policy) {
+    static const pair<const char*, TlbReplacement> names[] = {
+        {"random", TLB_REPLACE_RANDOM}, {"fifo", TLB_REPLACE_FIFO}, {"lru", TLB_REPLACE_LRU},
+        {"clock", TLB_REPLACE_CLOCK}, {"srrip", TLB_REPLACE_SRRIP}
+    };
+    for (const auto& entry : names) {
+        if (name == entry.first) {
+            policy = entry.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parseTlbPrefetchList(const string& value, vector<TlbPrefetchKind>& kinds) {
+    static const pair<const char*, TlbPrefetchKind> names[] = {
+        {"none", TLB_PREFETCH_NONE}, {"sequential", TLB_PREFETCH_SEQUENTIAL},
+        {"stride", TLB_PREFETCH_STRIDE}, {"distance", TLB_PREFETCH_DISTANCE}
+    };
+    kinds.clear();
+    for (const string& name : splitList(value)) {
+        auto it = find_if(begin(names), end(names), [&name](const pair<const char*, TlbPrefetchKind>& entry) {
+            return name == entry.first;
+        });
+        if (it == end(names)) {
+            cerr << "Unknown TLB prefetcher: " << name << endl;
+            return false;
+        }
+        kinds.push_back(it->second);
+    }
+    return true;
+}
+
+static bool parseTlbReplacementList(const string& value, vector<TlbReplacement>& policies) {
+    policies.clear();
+    for (const string& name : splitList(value)) {
+        TlbReplacement policy;
+        if (!parseTlbReplacement(name, policy)) {
+            cerr << "Unknown TLB replacement policy: " << name << endl;
+            return false;
+        }
+        policies.push_back(policy);
+    }
+    return true;
+}
+
+static bool parseIndexHashList(const string& value, vector<TlbIndexHash>& hashes) {
+    hashes.clear();
+    for (const string& name : splitList(value)) {
+        if (name != "mod" && name != "xor") {
+            cerr << "Unknown TLB index hash: " << name << endl;
+            return false;
+        }
+        hashes.push_back(name == "xor" ? TLB_HASH_XOR : TLB_HASH_MODULO);
+    }
+    return true;
+}
+
+static bool parseL2PartitionList(const string& value, vector<TlbL2Partitioning>& partitionings) {
+    partitionings.clear();
+    for (const string& name : splitList(value)) {
+        if (name != "static" && name != "ucp") {
+            cerr << "Unknown L2 partitioning: " << name << endl;
+            return false;
+        }
+        partitionings.push_back(name == "ucp" ? TLB_L2_UCP : TLB_L2_STATIC);
+    }
+    return true;
+}
+
+static bool parsePlacementList(const string& value, vector<PlacementPolicy>& policies) {
+    static const pair<const char*, PlacementPolicy> names[] = {
+        {"fast", PLACE_FAST_FIRST}, {"slow", PLACE_SLOW_FIRST}, {"interleave", PLACE_INTERLEAVE}
+    };
+    policies.clear();
+    for (const string& name : splitList(value)) {
+        auto it = find_if(begin(names), end(names), [&name](const pair<const char*, PlacementPolicy>& entry) {
+            return name == entry.first;
+        });
+        if (it == end(names)) {
+            cerr << "Unknown placement policy: " << name << endl;
+            return false;
+        }
+        policies.push_back(it->second);
+    }
+    return true;
+}
+
+static bool parseReclaimPolicyList(const string& value, vector<ReclaimPolicy>& policies) {
+    static const pair<const char*, ReclaimPolicy> names[] = {
+        {"address", RECLAIM_ADDRESS}, {"clock", RECLAIM_CLOCK}, {"clock2", RECLAIM_CLOCK2},
+        {"wsclock", RECLAIM_WSCLOCK}, {"lru", RECLAIM_LRU}
+    };
+    policies.clear();
+    for (const string& name : splitList(value)) {
+        auto it = find_if(begin(names), end(names), [&name](const pair<const char*, ReclaimPolicy>& entry) {
+            return name == entry.first;
+        });
+        if (it == end(names)) {
+            cerr << "Unknown reclaim policy: " << name << endl;
+            return false;
+        }
+        policies.push_back(it->second);
+    }
+    return true;
+}
+
+// name:capacityMB:latency:bandwidth per tier
+static bool parseMemoryTiers(const string& value, vector<MemoryTierConfig>& tiers) {
+    tiers.clear();
+    for (const string& item : splitList(value)) {
+        stringstream ss(item);
+        string name, capacity, latency, bandwidth;
+        if (!getline(ss, name, ':') || !getline(ss, capacity, ':') || !getline(ss, latency, ':') ||
+            !getline(ss, bandwidth) || strtod(bandwidth.c_str(), nullptr) <= 0) {
+            cerr << "Bad memory tier (expected name:MB:latency:bandwidth): " << item << endl;
+            return false;
+        }
+        tiers.push_back({name, size_t(strtoull(capacity.c_str(), nullptr, 0)) << 20,
+                         uint32_t(strtoul(latency.c_str(), nullptr, 0)), strtod(bandwidth.c_str(), nullptr)});
+    }
+    return true;
+}
+
+static bool parseCachePolicy(const string& name, CachePolicy& policy) {
+    if (name == "lfu") {
+        policy = CACHE_LFU;
+    } else if (name == "lru") {
+        policy = CACHE_LRU;
+    } else if (name == "arc") {
+        policy = CACHE_ARC;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// directories stand for the regular files inside them, in name order
+static void addTraces(const string& path, vector<string>& traces) {
+    if (!filesystem::is_directory(path)) {
+        traces.push_back(path);
+        return;
+    }
+    vector<string> files;
+    for (const auto& entry : filesystem::directory_iterator(path)) {
+        if (entry.is_regular_file()) {
+            files.push_back(entry.path().string());
+        }
+    }
+    sort(files.begin(), files.end());
+    traces.insert(traces.end(), files.begin(), files.end());
+}
+
+// values of each sweep dimension, a single default value when the option was not given
+struct SweepGrid {
+    vector<bool> cacheChoice;
+    vector<uint32_t> l1Size{TlbConfig().l1_size};
+    vector<uint32_t> l2Size{TlbConfig().l2_size};
+    vector<uint32_t> l1Ways{TlbConfig().l1_ways};
+    vector<uint32_t> l2Ways{TlbConfig().l2_ways};
+    vector<TlbIndexHash> indexHash{TLB_HASH_MODULO};
+    vector<TlbReplacement> l1Policy{TlbConfig().l1_policy};
+    vector<TlbReplacement> l2Policy{TlbConfig().l2_policy};
+    vector<uint32_t> asidBits{TlbConfig().asid_bits};
+    vector<TlbL2Partitioning> l2Partitioning{TlbConfig().l2_partitioning};
+    uint32_t ucpEpoch = TlbConfig().ucp_epoch;
+    vector<uint32_t> pdeCacheSize{TlbConfig().pde_cache_size};
+    vector<uint32_t> pdeCacheWays{TlbConfig().pde_cache_ways};
+    TlbReplacement pdeCachePolicy = TlbConfig().pde_cache_policy;
+    vector<TlbPrefetchKind> prefetcher{TlbConfig().prefetcher};
+    vector<uint32_t> prefetchDegree{TlbConfig().prefetch_degree};
+    vector<uint32_t> prefetchBuffer{TlbConfig().prefetch_buffer};
+    vector<CachePolicy> cachePolicy{CACHE_LFU};
+    vector<uint32_t> cacheSize{CacheConfig().capacity};
+    uint32_t seed = 0;
+    CostModel costModel;
+    vector<bool> thp{ThpConfig().enabled};
+    vector<double> thpPromote{ThpConfig().promoteThreshold};
+    vector<double> thpDemote{ThpConfig().demoteThreshold};
+    ThpConfig thpConfig;   // the remaining (scalar) settings
+    vector<PlacementPolicy> placement{TieringConfig().placement};
+    vector<uint32_t> migrateInterval{TieringConfig().migrateInterval};
+    TieringConfig tieringConfig;   // the remaining (scalar) settings
+    vector<uint32_t> memoryMB{uint32_t(SimulationParams().memorySize >> 20)};
+    size_t swapSize = SimulationParams().diskSize;
+    string swapDirectory;
+    size_t lowWatermark = 0;
+    size_t highWatermark = 0;
+    vector<bool> kswapd{ReclaimConfig().kswapd};
+    vector<ReclaimPolicy> reclaimPolicy{ReclaimConfig().policy};
+    vector<uint32_t> cores{SimulationParams().cores};
+    bool parallel = SimulationParams().parallel;
+    int addressBits = SimulationParams().addressBits;
+    ReclaimConfig reclaimConfig;   // the remaining (scalar) settings
+};
+
+static vector<SimulationParams> expandGrid(const vector<string>& traces, const SweepGrid& grid) {
+    vector<SimulationParams> runs;
+    for (const string& trace : traces)
+    for (bool cacheChoice : grid.cacheChoice)
+    for (uint32_t l1Size : grid.l1Size)
+    for (uint32_t l2Size : grid.l2Size)
+    for (uint32_t l1Ways : grid.l1Ways)
+    for (uint32_t l2Ways : grid.l2Ways)
+    for (TlbIndexHash hash : grid.indexHash)
+    for (TlbReplacement l1Policy : grid.l1Policy)
+    for (TlbReplacement l2Policy : grid.l2Policy)
+    for (uint32_t asidBits : grid.asidBits)
+    for (TlbL2Partitioning l2Partitioning : grid.l2Partitioning)
+    for (uint32_t pdeCacheSize : grid.pdeCacheSize)
+    for (uint32_t pdeCacheWays : grid.pdeCacheWays)
+    for (TlbPrefetchKind prefetcher : grid.prefetcher)
+    for (uint32_t prefetchDegree : grid.prefetchDegree)
+    for (uint32_t prefetchBuffer : grid.prefetchBuffer)
+    for (bool thp : grid.thp)
+    for (double thpPromote : grid.thpPromote)
+    for (double thpDemote : grid.thpDemote)
+    for (PlacementPolicy placement : grid.placement)
+    for (uint32_t migrateInterval : grid.migrateInterval)
+    for (uint32_t memoryMB : grid.memoryMB)
+    for (bool kswapd : grid.kswapd)
+    for (ReclaimPolicy reclaimPolicy : grid.reclaimPolicy)
+    for (uint32_t cores : grid.cores)
+    for (CachePolicy policy : grid.cachePolicy)
+    for (uint32_t cacheSize : grid.cacheSize) {
+        SimulationParams params;
+        params.traceFile = trace;
+        params.cacheChoice = cacheChoice;
+        params.tlbConfig.l1_size = l1Size;
+        params.tlbConfig.l2_size = l2Size;
+        params.tlbConfig.l1_ways = l1Ways;
+        params.tlbConfig.l2_ways = l2Ways;
+        params.tlbConfig.index_hash = hash;
+        params.tlbConfig.l1_policy = l1Policy;
+        params.tlbConfig.l2_policy = l2Policy;
+        params.tlbConfig.asid_bits = asidBits;
+        params.tlbConfig.l2_partitioning = l2Partitioning;
+        params.tlbConfig.ucp_epoch = grid.ucpEpoch;
+        params.tlbConfig.pde_cache_size = pdeCacheSize;
+        params.tlbConfig.pde_cache_ways = pdeCacheWays;
+        params.tlbConfig.pde_cache_policy = grid.pdeCachePolicy;
+        params.tlbConfig.prefetcher = prefetcher;
+        params.tlbConfig.prefetch_degree = prefetchDegree;
+        params.tlbConfig.prefetch_buffer = prefetchBuffer;
+        params.tlbConfig.seed = grid.seed;
+        params.cacheConfig.policy = policy;
+        params.cacheConfig.capacity = cacheSize;
+        params.costModel = grid.costModel;
+        params.thpConfig = grid.thpConfig;
+        params.thpConfig.enabled = thp;
+        params.thpConfig.promoteThreshold = thpPromote;
+        params.thpConfig.demoteThreshold = thpDemote;
+        params.tieringConfig = grid.tieringConfig;
+        params.tieringConfig.placement = placement;
+        params.tieringConfig.migrateInterval = migrateInterval;
+        params.memorySize = size_t(memoryMB) << 20;
+        params.diskSize = grid.swapSize;
+        params.swapDirectory = grid.swapDirectory;
+        params.lowWatermark = grid.lowWatermark;
+        params.highWatermark = grid.highWatermark;
+        params.reclaimConfig = grid.reclaimConfig;
+        params.reclaimConfig.kswapd = kswapd;
+        params.reclaimConfig.policy = reclaimPolicy;
+        params.cores = cores;
+        params.parallel = grid.parallel;
+        params.addressBits = grid.addressBits;
+        runs.push_back(params);
+    }
+    return runs;
+}
+
+int main(int argc, char *argv[]) {
+    vector<string> traces;
+    string convertTo, outputFile, statsJson, statsCsv, stackDistance, l2Shares;
+    SweepGrid grid;
+    bool sweep = false;
+    size_t numThreads = 0;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i], value;
+        if (parseOption(arg, "convert", value)) {
+            convertTo = value;
+        } else if (parseOption(arg, "cache-choice", value)) {
+            grid.cacheChoice.clear();
+            for (uint32_t choice : parseNumberList(value)) {
+                grid.cacheChoice.push_back(choice != 0);
+            }
+        } else if (parseOption(arg, "seed", value)) {
+            grid.seed = strtoul(value.c_str(), nullptr, 0);
+        } else if (parseOption(arg, "l1-size", value)) {
+            grid.l1Size = parseNumberList(value);
+        } else if (parseOption(arg, "l2-size", value)) {
+            grid.l2Size = parseNumberList(value);
+        } else if (parseOption(arg, "l1-ways", value)) {
+            grid.l1Ways = parseNumberList(value);
+        } else if (parseOption(arg, "l2-ways", value)) {
+            grid.l2Ways = parseNumberList(value);
+        } else if (parseOption(arg, "tlb-hash", value)) {
+            if (!parseIndexHashList(value, grid.indexHash)) {
+                return 1;
+            }
+        } else if (parseOption(arg, "l1-policy", value)) {
+            if (!parseTlbReplacementList(value, grid.l1Policy)) {
+                return 1;
+            }
+        } else if (parseOption(arg, "l2-policy", value)) {
+            if (!parseTlbReplacementList(value, grid.l2Policy)) {
+                return 1;
+            }
+        } else if (parseOption(arg, "asid-bits", value)) {
+            grid.asidBits = parseNumberList(value);
+        } else if (parseOption(arg, "l2-partition", value)) {
+            if (!parseL2PartitionList(value, grid.l2Partitioning)) {
+                return 1;
+            }
+        } else if (parseOption(arg, "ucp-epoch", value)) {
+            grid.ucpEpoch = strtoul(value.c_str(), nullptr, 0);
+        } else if (parseOption(arg, "pde-cache", value)) {
+            grid.pdeCacheSize = parseNumberList(value);
+        } else if (parseOption(arg, "pde-cache-ways", value)) {
+            grid.pdeCacheWays = parseNumberList(value);
+        } else if (parseOption(arg, "pde-cache-policy", value)) {
+            if (!parseTlbReplacement(value, grid.pdeCachePolicy)) {
+                cerr << "Unknown TLB replacement policy: " << value << endl;
+                return 1;
+            }
+        } else if (parseOption(arg, "prefetch", value)) {
+            if (!parseTlbPrefetchList(value, grid.prefetcher)) {
+                return 1;
+            }
+        } else if (parseOption(arg, "prefetch-degree", value)) {
+            grid.prefetchDegree = parseNumberList(value);
+        } else if (parseOption(arg, "prefetch-buffer", value)) {
+            grid.prefetchBuffer = parseNumberList(value);
+        } else if (parseOption(arg, "l2-shares", value)) {
+            l2Shares = value;
+        } else if (parseOption(arg, "cache-policy", value)) {
+            grid.cachePolicy.clear();
+            for (const string& name : splitList(value)) {
+                CachePolicy policy;
+                if (!parseCachePolicy(name, policy)) {
+                    cerr << "Unknown cache policy: " << name << endl;
+                    return 1;
+                }
+                grid.cachePolicy.push_back(policy);
+            }
+        } else if (parseOption(arg, "cache-size", value)) {
+            grid.cacheSize = parseNumberList(value);
+        } else if (parseOption(arg, "thp", value)) {
+            grid.thp.clear();
+            for (const string& name : splitList(value)) {
+                grid.thp.push_back(name == "on" || name == "1");
+            }
+        } else if (parseOption(arg, "thp-promote", value)) {
+            grid.thpPromote = parseDoubleList(value);
+        } else if (parseOption(arg, "thp-demote", value)) {
+            grid.thpDemote = parseDoubleList(value);
+        } else if (parseOption(arg, "thp-demote-scans", value)) {
+            grid.thpConfig.demoteScans = strtoul(value.c_str(), nullptr, 0);
+        } else if (parseOption(arg, "thp-scan-interval", value)) {
+            grid.thpConfig.scanInterval = max(1ul, strtoul(value.c_str(), nullptr, 0));
+        } else if (parseOption(arg, "memory", value)) {
+            grid.memoryMB = parseNumberList(value);
+        } else if (parseOption(arg, "address-bits", value)) {
+            grid.addressBits = strtol(value.c_str(), nullptr, 0);
+        } else if (parseOption(arg, "swap-size", value)) {
+            grid.swapSize = size_t(strtoull(value.c_str(), nullptr, 0)) << 20;
+        } else if (parseOption(arg, "swap-dir", value)) {
+            grid.swapDirectory = value;
+        } else if (parseOption(arg, "low-watermark", value)) {
+            grid.lowWatermark = size_t(strtoull(value.c_str(), nullptr, 0)) << 20;
+        } else if (parseOption(arg, "high-watermark", value)) {
+            grid.highWatermark = size_t(strtoull(value.c_str(), nullptr, 0)) << 20;
+        } else if (parseOption(arg, "kswapd", value)) {
+            grid.kswapd.clear();
+            for (const string& name : splitList(value)) {
+                grid.kswapd.push_back(name == "on" || name == "1");
+            }
+        } else if (parseOption(arg, "kswapd-batch", value)) {
+            grid.reclaimConfig.batchPages = max(1ul, strtoul(value.c_str(), nullptr, 0));
+        } else if (parseOption(arg, "reclaim-policy", value)) {
+            if (!parseReclaimPolicyList(value, grid.reclaimPolicy)) {
+                return 1;
+            }
+        } else if (parseOption(arg, "reclaim-scope", value)) {
+            if (value != "global" && value != "local") {
+                cerr << "Unknown reclaim scope: " << value << endl;
+                return 1;
+            }
+            grid.reclaimConfig.local = value == "local";
+        } else if (parseOption(arg, "hand-spread", value)) {
+            grid.reclaimConfig.handSpread = max(1ul, strtoul(value.c_str(), nullptr, 0));
+        } else if (parseOption(arg, "ws-window", value)) {
+            grid.reclaimConfig.wsWindow = strtoull(value.c_str(), nullptr, 0);
+        } else if (parseOption(arg, "cores", value)) {
+            grid.cores = parseNumberList(value);
+        } else if (parseOption(arg, "parallel", value)) {
+            grid.parallel = value == "on" || value == "1";
+        } else if (parseOption(arg, "tiers", value)) {
+            if (!parseMemoryTiers(value, grid.tieringConfig.tiers)) {
+                return 1;
+            }
+        } else if (parseOption(arg, "placement", value)) {
+            if (!parsePlacementList(value, grid.placement)) {
+                return 1;
+            }
+        } else if (parseOption(arg, "migrate-interval", value)) {
+            grid.migrateInterval = parseNumberList(value);
+        } else if (parseOption(arg, "migrate-sample", value)) {
+            grid.tieringConfig.sampleInterval = max(1ul, strtoul(value.c_str(), nullptr, 0));
+        } else if (parseOption(arg, "hot-threshold", value)) {
+            grid.tieringConfig.hotThreshold = strtoul(value.c_str(), nullptr, 0);
+        } else if (parseOption(arg, "cold-threshold", value)) {
+            grid.tieringConfig.coldThreshold = strtoul(value.c_str(), nullptr, 0);
+        } else if (parseOption(arg, "migrate-max", value)) {
+            grid.tieringConfig.maxMigrations = strtoul(value.c_str(), nullptr, 0);
+        } else if (parseOption(arg, "latency", value)) {
+            for (const string& item : splitList(value)) {
+                size_t equals = item.find('=');
+                if (equals == string::npos ||
+                    !grid.costModel.set(item.substr(0, equals), strtoul(item.c_str() + equals + 1, nullptr, 0))) {
+                    cerr << "Unknown latency: " << item << endl;
+                    return 1;
+                }
+            }
+        } else if (parseOption(arg, "threads", value)) {
+            numThreads = strtoul(value.c_str(), nullptr, 0);
+        } else if (parseOption(arg, "output", value)) {
+            outputFile = value;
+        } else if (parseOption(arg, "stats-json", value)) {
+            statsJson = value;
+        } else if (parseOption(arg, "stats-csv", value)) {
+            statsCsv = value;
+        } else if (parseOption(arg, "stack-distance", value)) {
+            stackDistance = value;
+        } else if (arg == "--sweep") {
+            sweep = true;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            cerr << "Unknown option: " << arg << endl;
+            return 1;
+        } else {
+            addTraces(arg, traces);
+        }
+    }
+    if (traces.empty()) {
+        cerr << "Usage: " << argv[0] << " [options] <trace file or directory>..." << endl;
         return 1;
     }
 
-    string line;
-    bool switchExecuted = false;
-    while (getline(inputFile, line)) {
-        //cout << "Executing command: " << line << endl;
-        istringstream iss(line);
-        uint32_t pid;
-        string instruction;
-        uint32_t value = 0;
-
-        iss >> pid >> instruction;
-        if (instruction == "switch") {
-            if (switchExecuted) {
-                // If a switch has already been executed, break out of the loop
-                break;
-            }
-            osInstance.switchToProcess(pid);
-            auto& segmentAccessMap = osInstance.runningProc->hugePageSegmentAccessMap;
-            auto& pageSizeToSegmentCountMap = osInstance.pageSizeToSegmentCountMap;
-            for (const auto& hugePageEntry : segmentAccessMap) {
-                  //cout << "Huge Page PFN: " << hugePageEntry.first << endl;
-
-                  uint32_t numSegments = pageSizeToSegmentCountMap[hugePageEntry.first];
-                  //cout << "  Total 4KB segments in this huge page: " << numSegments << endl;
-                  /*
-                  for (const auto& segmentEntry : hugePageEntry.second) {
-                      cout << "  4KB Segment Offset: " << segmentEntry.first 
-                          << ", Access Count: " << segmentEntry.second << endl;
-                  }*/
-              }
+    if (!convertTo.empty()) {
+        try {
+            size_t count = convertTextTrace(traces[0].c_str(), convertTo.c_str());
+            cout << "Wrote " << count << " records to " << convertTo << endl;
+        } catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    bool promptCacheChoice = grid.cacheChoice.empty();
+    if (promptCacheChoice) {
+        grid.cacheChoice.push_back(false);
+    }
+    vector<SimulationParams> runs = expandGrid(traces, grid);
+    if (runs.empty()) {
+        cerr << "Error: empty parameter grid." << endl;
+        return 1;
+    }
+
+    if (sweep || runs.size() > 1) {
+        if (!statsCsv.empty()) {
+            cerr << "Error: --stats-csv needs a single run, use --output for sweeps." << endl;
+            return 1;
+        }
+        if (!stackDistance.empty()) {
+            cerr << "Error: --stack-distance needs a single run." << endl;
+            return 1;
+        }
+        if (!l2Shares.empty()) {
+            cerr << "Error: --l2-shares needs a single run." << endl;
+            return 1;
+        }
+        vector<SimulationResult> results = runSweep(runs, numThreads);
+        if (outputFile.empty()) {
+            writeSweepCsv(cout, results);
         } else {
-            if (!(iss >> hex >> value)) {
-                cerr << "Error parsing value for instruction: " << instruction << endl;
-                continue;
+            ofstream out(outputFile);
+            if (!out) {
+                cerr << "Error: Unable to open " << outputFile << endl;
+                return 1;
+            }
+            writeSweepCsv(out, results);
+        }
+        if (!statsJson.empty()) {
+            ofstream out(statsJson);
+            if (!out) {
+                cerr << "Error: Unable to open " << statsJson << endl;
+                return 1;
             }
-            osInstance.handleInstruction(instruction, value, pid);
+            writeSweepJson(out, results);
         }
+        return 0;
+    }
+
+    SimulationParams params = runs[0];
+    if (promptCacheChoice) {
+        std::cout << "Choose caching strategy (1 for Huge Pages, 0 for Subpages): ";
+        std::cin >> params.cacheChoice;
     }
 
-    cout << "Cache Hits: " << osInstance.cacheHit << endl;
-    cout << "Cache Misses: " << osInstance.cacheMiss << endl;
-    if (osInstance.cacheHit + osInstance.cacheMiss > 0) {
-        double hitRate = static_cast<double>(osInstance.cacheHit) / 
-                        (osInstance.cacheHit + osInstance.cacheMiss);
+    unique_ptr<os> osPtr;
+    try {
+        osPtr.reset(new os(params.memorySize, params.diskSize, params.highWatermark, params.lowWatermark,
+                           params.cacheChoice, params.tlbConfig, params.cacheConfig, params.costModel,
+                           params.thpConfig, params.tieringConfig, params.swapDirectory,
+                           params.reclaimConfig, params.cores, params.addressBits));
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    os& osInstance = *osPtr;
+    cout << "TLB initialized" << endl;
+    if (!stackDistance.empty()) {
+        try {
+            osInstance.enableStackDistance();
+        } catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+    }
+
+    unique_ptr<TraceReader> trace;
+    try {
+        trace.reset(new TraceReader(params.traceFile.c_str()));
+    } catch (const exception& e) {
+        cerr << "Error: Unable to open file." << endl;
+        return 1;
+    }
+    try {
+        replayTrace(osInstance, *trace, params.parallel);
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    const SimStats& stats = osInstance.getStats();
+    cout << "Cache Hits: " << stats.cache_hit << endl;
+    cout << "Cache Misses: " << stats.cache_miss << endl;
+    if (stats.cache_hit + stats.cache_miss > 0) {
+        double hitRate = static_cast<double>(stats.cache_hit) / 
+                        (stats.cache_hit + stats.cache_miss);
         cout << "Cache Hit Rate: " << hitRate << endl;
     }
    
-    cout << "Total memory access attempts: " << memory_access_attempts << endl;
-    inputFile.close();
+    cout << "Total memory access attempts: " << stats.memory_access_attempts << endl;
+    cout << "Cycles: " << stats.totalCycles() << endl;
+    cout << "AMAT (cycles): " << stats.amat() << endl;
+    if (stats.tiers.size() > 1) {
+        cout << "Fast tier access fraction: " << stats.fastTierFraction() << endl;
+        cout << "Migrations (up/down): " << stats.migration_promotions << " / " << stats.migration_demotions
+             << ", " << stats.migration_bytes << " bytes" << endl;
+    }
+    if (stats.page_faults + stats.invalid_accesses > 0) {
+        cout << "Page faults: " << stats.page_faults << endl;
+        cout << "Invalid accesses: " << stats.invalid_accesses << endl;
+    }
+    if (stats.swap_outs + stats.swap_ins > 0) {
+        cout << "Swap outs: " << stats.swap_outs << endl;
+        cout << "Swap ins: " << stats.swap_ins << endl;
+        cout << "Direct reclaim stalls: " << stats.direct_reclaims << " (" << stats.direct_reclaim_pages
+             << " pages), kswapd wakeups: " << stats.kswapd_wakeups << " (" << stats.kswapd_pages << " pages)" << endl;
+        cout << "Reclaim scanned: " << stats.reclaim_scanned << " pages, " << stats.reclaim_referenced
+             << " found referenced" << endl;
+    }
+    if (params.cores > 1) {
+        cout << "TLB shootdowns: " << stats.tlb_shootdowns << " (" << stats.shootdown_ipis << " IPIs, "
+             << stats.cycles[COST_SHOOTDOWN] << " cycles)" << endl;
+    }
+    osInstance.reportPageTableUsage(cout);
+
+    if (!statsJson.empty()) {
+        ofstream out(statsJson);
+        if (!out) {
+            cerr << "Error: Unable to open " << statsJson << endl;
+            return 1;
+        }
+        stats.writeJson(out);
+    }
+    if (!statsCsv.empty()) {
+        ofstream out(statsCsv);
+        if (!out) {
+            cerr << "Error: Unable to open " << statsCsv << endl;
+            return 1;
+        }
+        stats.writeCsv(out);
+    }
+    if (!l2Shares.empty()) {
+        ofstream out(l2Shares);
+        if (!out) {
+            cerr << "Error: Unable to open " << l2Shares << endl;
+            return 1;
+        }
+        stats.writeL2SharesCsv(out);
+    }
+    if (!stackDistance.empty()) {
+        ofstream out(stackDistance);
+        if (!out) {
+            cerr << "Error: Unable to open " << stackDistance << endl;
+            return 1;
+        }
+        osInstance.writeStackDistanceCurves(out);
+    }
 
     /*
     cout << "OS initialized" << endl;
@@ -1,4 +1,4 @@
-#include "TwoLevelPageTable.h"
+#include "PageTable.h"
 #include "process.h"
 #include "os.h"
 #include "tlb.h"
@@ -14,95 +14,279 @@
 #include <stdexcept>
 #include <cstdint>
 #include <map>
-
-int memory_access_attempts = 0;
+#include <cstring>
 
 using namespace std;
 
-os::os(size_t memorySize, size_t diskSize, uint32_t high_watermarkGiven,
-       uint32_t low_watermarkGiven, bool cacheChoice)
-    : minPageSize(4096), memoryMap(memorySize / minPageSize, false),
-      //diskMap(diskSize / minPageSize, false),
+// without configured tiers all memory is one tier at the cost model's memory latency
+static vector<MemoryTierConfig> memoryTiers(size_t memorySize, const CostModel& costModel,
+                                            const TieringConfig& tieringConfig) {
+    if (!tieringConfig.tiers.empty()) {
+        return tieringConfig.tiers;
+    }
+    return {{"dram", memorySize, costModel.cache_miss, 16}};
+}
+
+// the core bound to a thread of replayOnCores(), and how the thread holds memoryLock for
+// the record it replays
+enum LockHold { HOLD_NONE, HOLD_SHARED, HOLD_EXCLUSIVE };
+static thread_local uint32_t boundCore = 0;
+static thread_local LockHold lockHold = HOLD_NONE;
+
+os::os(size_t memorySize, size_t diskSize, size_t high_watermarkGiven,
+       size_t low_watermarkGiven, bool cacheChoice, const TlbConfig& tlbConfig,
+       const CacheConfig& cacheConfig, const CostModel& costModel, const ThpConfig& thpConfig,
+       const TieringConfig& tieringConfig, const string& swapDirectory, const ReclaimConfig& reclaimConfig,
+       uint32_t numCores, int addressBits)
+    : minPageSize(4096), addressBits(addressBits), Cache_Size(cacheConfig.capacity),
+      frameAllocator(memoryTiers(memorySize, costModel, tieringConfig), tieringConfig.placement,
+                     addressBits == 32 ? 20 : 31),
+      swapDevice(diskSize, swapDirectory),
       cacheChoice(cacheChoice),
-      cache4KB(),
-      cacheHugePage(),
-      cacheHit(0), cacheMiss(0),
       pageSizeToSegmentCountMap(),
-      high_watermark(high_watermarkGiven), low_watermark(low_watermarkGiven),
-      totalFreeSize(-1), tlb(Tlb(64, 1024, 4)) {
+      high_watermark(high_watermarkGiven), low_watermark(low_watermarkGiven), reclaimConfig(reclaimConfig),
+      cores(numCores), placement(numCores), tlbConfig(tlbConfig), costModel(costModel), thpConfig(thpConfig),
+      tieringConfig(tieringConfig) {
+    // the page tables of the processes are made on their first switch, check the width now
+    makePageTable(0, addressBits);
+    if (numCores == 0 || numCores > MAX_CORES) {
+        throw invalid_argument("The number of cores must be between 1 and " + to_string(MAX_CORES));
+    }
+    for (size_t t = 0; t < frameAllocator.tierCount(); t++) {
+        stats.tiers.push_back(TierCounters());
+        stats.tiers.back().name = frameAllocator.tier(t).name;
+    }
+    for (Core& core : cores) {
+        core.tlb.reset(new Tlb(tlbConfig, &core.stats));
+        core.prefetcher.reset(make_tlb_prefetcher(tlbConfig.prefetcher, tlbConfig.prefetch_degree));
+        core.cache4KB = makePageCache<CacheKey4KB>(cacheConfig);
+        core.cacheHugePage = makePageCache<CacheKeyHugePage>(cacheConfig);
+        core.stats.tiers = stats.tiers;
+    }
+    // watermarks default to 1/40 and 1/20 of physical memory
+    size_t memoryBytes = frameAllocator.freeBytes();
+    memoryPages = memoryBytes / minPageSize;
+    if (low_watermark == 0) {
+        low_watermark = memoryBytes / 40;
+    }
+    if (high_watermark == 0) {
+        high_watermark = max<size_t>(memoryBytes / 20, low_watermark);
+    }
+    if (reclaimConfig.kswapd) {
+        kswapdThread = thread(&os::kswapdMain, this);
+    }
 }
 
 os::~os() {
+    try {
+        stopKswapd();
+    } catch (const exception&) {
+        // the run already failed or its results were read, nothing to report to
+    }
 }
 
 
-uint32_t os::allocateMemory(uint32_t size) {
-    if (totalFreeSize - size < low_watermark) {
-        // Swap out pages to maintain free memory above the low watermark
-        uint32_t sizeTobeFree = high_watermark - (totalFreeSize - size);
-        swapOutToMeetWatermark(sizeTobeFree);
+uint64_t os::allocateMemory(uint64_t size) {
+    // whole pages, so that the heap stays page aligned for the next allocation
+    size = (size + minPageSize - 1) & ~uint64_t(minPageSize - 1);
+    // Swap out pages to maintain free memory above the low watermark
+    reclaimBelowLowWatermark(size);
+
+    // memory is overcommitted: what still does not fit after reclaim is left to demand-zero faults
+    uint64_t resident = size;
+    if (frameAllocator.freeBytes() < size) {
+        directReclaim(size - frameAllocator.freeBytes());
+        if (frameAllocator.freeBytes() < size) {
+            resident = frameAllocator.freeBytes() & ~(minPageSize - 1);
+        }
     }
 
-    auto frames = findPhysicalFrames(size);
-    uint32_t vpn = (runningProc->heap) >> 12;   // 12 is 4k page's intra-page offset bits
+    process& proc = *running();
+    auto frames = findPhysicalFrames(resident);
+    uint64_t baseAddress = proc.heap;
+    uint64_t vpn = baseAddress >> 12;   // 12 is 4k page's intra-page offset bits
     for (auto p : frames) {
         auto pfn = p.first;
         auto frame_size = p.second;
-        runningProc->pageTable.setMapping(frame_size, vpn, pfn);
+        proc.pageTable->setMapping(frame_size, vpn, pfn);
         vpn += frame_size / minPageSize;
     }
-    runningProc->allocateMem(size);
+    for (uint64_t lazy = resident; lazy < size; lazy += minPageSize, vpn++) {
+        proc.pageTable->setMapping(minPageSize, vpn, 0);
+        proc.pageTable->updatePresentBit(vpn);
+        proc.demandZeroPages.insert(vpn);
+    }
+    proc.allocateMem(size);
+    return baseAddress;
 }
 
-void os::freeMemory(uint32_t baseAddress) {
-    uint32_t sizeToFree = (runningProc->heap - baseAddress);
-    uint32_t pagesToFree = sizeToFree / minPageSize;
-    uint32_t sizeFreed = 0;
-    uint32_t vpn = baseAddress >> 12;
+void os::freeMemory(uint64_t baseAddress) {
+    process& proc = *running();
+    uint64_t sizeToFree = (proc.heap - baseAddress);
+    uint64_t pagesToFree = sizeToFree / minPageSize;
+    uint64_t sizeFreed = 0;
+    uint64_t vpn = baseAddress >> 12;
 
+    // the whole range is one shootdown round
+    beginShootdownBatch();
     while (sizeFreed != sizeToFree) {
-        auto p = runningProc->pageTable.translate(baseAddress);
-        runningProc->pageTable.free(vpn);
-        uint32_t basePfn = p.pfn, pageSize = p.page_size;
-        for (uint32_t pfn = basePfn; pfn < basePfn + pageSize / minPageSize;
-             pfn++) {
-            memoryMap[pfn] = false;
+        PTE p;
+        WalkStatus status = walkPageTable(proc, baseAddress, p);
+        if (status == WALK_INVALID) {
+            break;
+        }
+        proc.pageTable->free(vpn);
+        uint32_t pageSize = p.page_size;
+        proc.lastUse.erase(p.vpn);
+        proc.pageAge.erase(p.vpn);
+        if (status == WALK_OK) {
+            frameAllocator.free(p.pfn);   // swapped out pages hold no frame
+        } else {
+            proc.reclaimedPages.erase(p.vpn);
+            proc.demandZeroPages.erase(p.vpn);
+            auto slot = proc.swapSlots.find(p.vpn);
+            if (slot != proc.swapSlots.end()) {
+                swapDevice.free(slot->second, pageSize / SWAP_SLOT_SIZE);
+                proc.swapSlots.erase(slot);
+            }
         }
+        invalidateTranslation(proc, p.vpn, pageSize);
         vpn += pageSize >> 12;
         sizeFreed += pageSize;
         baseAddress += pageSize;
     }
-    runningProc->freeMem(sizeToFree);
+    endShootdownBatch();
+    proc.freeMem(sizeToFree);
+}
 
-    // Invalidate TLB entry for this VPN
+// Walk cost: the directory reads (one per level above the PTE pages that the walk reaches)
+// are skipped on a page-walk cache hit, the PTE read happens whenever the walk gets to a PTE
+// page. The directory slots pointing to a PTE page are cached. A walk that stops at a
+// directory slot without a PTE page costs only its directory reads, also with the cache off.
+// The cache is an oracle shortcut: it is consulted only after hasPTEPage() has looked at the
+// real table, so a stale entry never sends a walk to a PTE page that is gone.
+WalkStatus os::walkPageTable(const process& proc, uint64_t vaddr, PTE& pte) {
+    Core& core = thisCore();
+    uint64_t dirIdx = proc.pageTable->directorySlot(vaddr);
+    bool hasPTEPage = proc.pageTable->hasPTEPage(vaddr);
+    core.stats.page_walks++;
+    if (hasPTEPage && core.tlb->pde_lookup(proc.pid, dirIdx)) {
+        core.stats.pde_cache_hits++;
+    } else {
+        uint32_t reads = proc.pageTable->directoryReads(vaddr);
+        core.stats.walk_pde_refs += reads;
+        core.stats.memory_hit += reads;
+        if (hasPTEPage) {
+            core.tlb->pde_fill(proc.pid, dirIdx);
+        }
+    }
+    if (hasPTEPage) {
+        core.stats.walk_pte_refs++;
+        core.stats.memory_hit++;
+    }
+    return proc.pageTable->translate(vaddr, pte);
+}
+
+// Prefetch walks go through walkPageTable, so their memory references show up in memory_hit
+// as well as prefetch_walks. Pages that are not present or not mapped are skipped: a
+// prefetch never faults. Candidates beyond the address space are dropped before the walk.
+void os::prefetchAfterMiss(Core& core, process& proc, uint64_t address, const PTE& pte) {
+    core.prefetcher->on_miss(proc.pid, address >> 12, pte.vpn, pte.page_size >> 12, core.prefetchCandidates);
+    uint64_t endVpn = proc.pageTable->addressSpaceEnd() >> 12;
+    for (uint64_t vpn : core.prefetchCandidates) {
+        uint64_t vaddr = vpn << 12;
+        if (vpn >= endVpn || core.tlb->contains(vaddr, proc.pid)) {
+            continue;
+        }
+        PTE candidate;
+        core.stats.prefetch_walks++;
+        if (walkPageTable(proc, vaddr, candidate) != WALK_OK) {
+            continue;
+        }
+        core.tlb->prefetch_fill(core.tlb->create_tlb_entry(candidate.pfn, candidate.page_size, candidate.vpn, proc.pid));
+        core.stats.prefetch_issued++;
+    }
+}
+
+// Drop the tlb entries for the page whose first 4KB is vpn, and the page-walk cache
+// entries of every directory slot the page spans (its PTE pages may have been released).
+// That is a tlb shootdown: the initiating core invalidates its own tlbs, every other core
+// that ran the process (l2 entries are pid tagged and survive switches) is interrupted.
+// kswapd runs on core 0. The other cores do not run meanwhile: their replay is stopped by
+// memoryLock.
+void os::invalidateTranslation(process& proc, uint64_t vpn, uint32_t pageSize) {
+    uint32_t initiator = backgroundReclaim ? 0 : coreIndex();
+    uint64_t firstDirIdx = proc.pageTable->directorySlot(vpn << 12);
+    uint64_t lastDirIdx = proc.pageTable->directorySlot(((vpn + pageSize / minPageSize) << 12) - 1);
+    for (uint32_t c = 0; c < cores.size(); c++) {
+        if (c != initiator && !(proc.coreMask >> c & 1)) {
+            continue;
+        }
+        cores[c].tlb->invalidate_tlb(proc.pid, vpn);
+        for (uint64_t dirIdx = firstDirIdx; dirIdx <= lastDirIdx; dirIdx++) {
+            cores[c].tlb->pde_invalidate(proc.pid, dirIdx);
+        }
+    }
+    uint64_t remote = proc.coreMask & ~(1ull << initiator);
+    stats.shootdown_invalidations += __builtin_popcountll(remote);
+    pendingShootdown |= remote;
+    if (shootdownBatches == 0) {
+        sendShootdown();
+    }
+}
+
+void os::endShootdownBatch() {
+    if (--shootdownBatches == 0) {
+        sendShootdown();
+    }
+}
+
+// One round: the initiator waits for every interrupted core, each of which runs the
+// handler on behalf of its process. kswapd's waits are not charged to anyone.
+void os::sendShootdown() {
+    if (!pendingShootdown) {
+        return;
+    }
+    stats.tlb_shootdowns++;
+    stats.shootdown_ipis += __builtin_popcountll(pendingShootdown);
+    if (!backgroundReclaim && running()) {
+        stats.charge(running()->pid, coreIndex(), COST_SHOOTDOWN, costModel.shootdown);
+    }
+    for (uint32_t c = 0; c < cores.size(); c++) {
+        if ((pendingShootdown >> c & 1) && cores[c].proc != NO_PROCESS) {
+            stats.charge(processes[cores[c].proc].pid, c, COST_SHOOTDOWN, costModel.ipi);
+        }
+    }
+    pendingShootdown = 0;
 }
 
 uint32_t os::createProcess(long int pid) {
-    process newProcess(pid);
+    process newProcess(pid, addressBits);
 
     uint32_t codeSize = 4096 * 1024;
     newProcess.code = codeSize - 1;
     newProcess.heap = codeSize;
-    uint32_t code_vpn = 0;
+    uint64_t code_vpn = 0;
     auto code_frames = findPhysicalFrames(codeSize);
     for (auto &p : code_frames) {
         uint32_t pfn = p.first;
         uint32_t size = p.second;
-        newProcess.pageTable.setMapping(size, code_vpn, pfn);
+        newProcess.pageTable->setMapping(size, code_vpn, pfn);
         code_vpn += size / minPageSize;
     }
 
     uint32_t stackSize = 4096 * 1024;
     auto stack_frames = findPhysicalFrames(stackSize);
-    newProcess.stack = 0xFFFFFFFF - stackSize + 1;
-    uint32_t stack_vpn = newProcess.stack / minPageSize;
+    // the stack ends at the top of the address space
+    newProcess.stack = newProcess.pageTable->addressSpaceEnd() - stackSize;
+    uint64_t stack_vpn = newProcess.stack / minPageSize;
     for (auto &p : stack_frames) {
         uint32_t pfn = p.first;
         uint32_t size = p.second;
-        newProcess.pageTable.setMapping(size, stack_vpn, pfn);
+        newProcess.pageTable->setMapping(size, stack_vpn, pfn);
         stack_vpn += size / minPageSize;
     }
-    processes.push_back(newProcess);
+    processes.push_back(std::move(newProcess));
 
     return pid;
 }
@@ -120,63 +304,406 @@ void os::destroyProcess(long int pid) {
 }
 */
 
-void os::swapOutToMeetWatermark(uint32_t sizeToFree) {
+// Local reclaim only applies to the process stalled in direct reclaim; what it cannot give
+// is taken from everyone. The unmaps of one call are flushed in one shootdown round.
+void os::swapOutToMeetWatermark(size_t sizeToFree) {
     size_t freedMemory = 0;
-    uint32_t pfnBits = 20;
+    beginShootdownBatch();
+    if (reclaimConfig.local && !backgroundReclaim && running()) {
+        freedMemory = reclaimPages(sizeToFree, thisCore().proc);
+    }
+    if (freedMemory < sizeToFree) {
+        reclaimPages(sizeToFree - freedMemory, processes.size());
+    }
+    endShootdownBatch();
+}
 
-    for (process& proc : processes) {
-        if (freedMemory >= sizeToFree) break; 
+size_t os::reclaimPages(size_t sizeToFree, size_t scope) {
+    switch (reclaimConfig.policy) {
+    case RECLAIM_ADDRESS:
+        return reclaimByAddress(sizeToFree, scope);
+    case RECLAIM_CLOCK:
+        return reclaimByClock(sizeToFree, scope);
+    case RECLAIM_CLOCK2:
+        return reclaimByTwoHandedClock(sizeToFree, scope);
+    case RECLAIM_WSCLOCK:
+        return reclaimByWsClock(sizeToFree, scope);
+    case RECLAIM_LRU:
+        return reclaimByAge(sizeToFree, scope);
+    }
+    return 0;
+}
 
-        uint32_t currentAddress = proc.code; // Start from the beginning
-        uint32_t endAddress = proc.heap;
+ReclaimClock& os::clockOf(size_t scope) {
+    return scope == processes.size() ? reclaimClock : processes[scope].reclaimClock;
+}
+
+// Software walks, not counted as MMU references. Swapped out and unmapped pages are skipped.
+bool os::advanceHand(ReclaimHand& hand, size_t scope, PTE& page) {
+    bool global = scope == processes.size();
+    if (!global) {
+        hand.proc = scope;
+    }
+    for (int wraps = 0; wraps < 2;) {
+        if (hand.proc >= processes.size()) {
+            hand = ReclaimHand();
+            wraps++;
+            continue;
+        }
+        process& proc = processes[hand.proc];
+        if (hand.address >= proc.heap && hand.address < proc.stack) {
+            hand.address = proc.stack;
+        }
+        if (hand.address >= proc.pageTable->addressSpaceEnd()) {
+            hand.address = 0;
+            if (global) {
+                hand.proc++;
+            } else {
+                wraps++;
+            }
+            continue;
+        }
+        WalkStatus status = proc.pageTable->translate(hand.address, page);
+        if (status == WALK_INVALID) {
+            hand.address += minPageSize;
+            continue;
+        }
+        hand.address = (uint64_t(page.vpn) << 12) + page.page_size;
+        if (status == WALK_OK) {
+            stats.reclaim_scanned++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void os::residentPages(size_t scope, vector<pair<size_t, PTE> >& pages) {
+    size_t first = scope == processes.size() ? 0 : scope;
+    size_t last = scope == processes.size() ? processes.size() : scope + 1;
+    for (size_t p = first; p < last; p++) {
+        process& proc = processes[p];
+        const uint64_t ranges[2][2] = {{0, proc.heap}, {proc.stack, proc.pageTable->addressSpaceEnd()}};
+        for (const auto& range : ranges) {
+            for (uint64_t address = range[0]; address < range[1];) {
+                PTE page;
+                WalkStatus status = proc.pageTable->translate(address, page);
+                if (status == WALK_INVALID) {
+                    address += minPageSize;
+                    continue;
+                }
+                address = (uint64_t(page.vpn) << 12) + page.page_size;
+                if (status == WALK_OK) {
+                    pages.push_back({p, page});
+                }
+            }
+        }
+    }
+    stats.reclaim_scanned += pages.size();
+}
+
+// 1. address order: code and heap, then the stack, process by process
+size_t os::reclaimByAddress(size_t sizeToFree, size_t scope) {
+    vector<pair<size_t, PTE> > pages;
+    residentPages(scope, pages);
+    size_t freedMemory = 0;
+    for (const auto& victim : pages) {
+        if (freedMemory >= sizeToFree) {
+            break;
+        }
+        const PTE& page = victim.second;
+        if (!swapOutPage(processes[victim.first], page.vpn, page.pfn, page.page_size)) {
+            break;      // swap is full
+        }
+        freedMemory += page.page_size;
+    }
+    return freedMemory;
+}
 
-        while (currentAddress < endAddress && freedMemory < sizeToFree) {
-            auto pteAndPageSize =
-                runningProc->pageTable.translate(currentAddress);
-            uint32_t pageSize = pteAndPageSize.page_size;
-            uint32_t pfn = pteAndPageSize.pfn;
-            uint32_t vpn = currentAddress / pageSize;
+// 2. clock: every page found unreferenced is taken. Reclaim runs with the replay stopped,
+//    so at worst a lap clears every bit and the next one finds victims.
+size_t os::reclaimByClock(size_t sizeToFree, size_t scope) {
+    ReclaimHand& hand = clockOf(scope).front;
+    size_t freedMemory = 0;
+    PTE page;
+    while (freedMemory < sizeToFree && advanceHand(hand, scope, page)) {
+        process& proc = processes[hand.proc];
+        if (proc.pageTable->testAndClearAccessed(page.vpn)) {
+            stats.reclaim_referenced++;
+            continue;
+        }
+        if (!swapOutPage(proc, page.vpn, page.pfn, page.page_size)) {
+            break;
+        }
+        freedMemory += page.page_size;
+    }
+    return freedMemory;
+}
 
-            swapOutPage(vpn, pfn); // Call swapOutPage for the calculated VPN
+// 3. two-handed clock: the trail holds the pages between the hands. The back hand checks
+//    that its page is still the one the front hand passed, it may have been freed, swapped
+//    out or remapped since.
+size_t os::reclaimByTwoHandedClock(size_t sizeToFree, size_t scope) {
+    ReclaimClock& clock = clockOf(scope);
+    size_t freedMemory = 0;
+    size_t steps = 2 * (memoryPages + reclaimConfig.handSpread);
+    PTE page;
+    while (freedMemory < sizeToFree && steps-- > 0) {
+        bool advanced = advanceHand(clock.front, scope, page);
+        if (advanced) {
+            processes[clock.front.proc].pageTable->testAndClearAccessed(page.vpn);
+            clock.trail.push_back({clock.front.proc, page.vpn});
+        }
+        if (clock.trail.empty() || (advanced && clock.trail.size() <= reclaimConfig.handSpread)) {
+            if (!advanced) {
+                break;
+            }
+            continue;
+        }
+        pair<size_t, uint64_t> back = clock.trail.front();
+        clock.trail.pop_front();
+        process& proc = processes[back.first];
+        PTE victim;
+        if (proc.pageTable->translate(back.second << 12, victim) != WALK_OK || victim.vpn != back.second) {
+            continue;
+        }
+        if (proc.pageTable->testAndClearAccessed(victim.vpn)) {
+            stats.reclaim_referenced++;
+            continue;
+        }
+        if (!swapOutPage(proc, victim.vpn, victim.pfn, victim.page_size)) {
+            break;
+        }
+        freedMemory += victim.page_size;
+    }
+    return freedMemory;
+}
 
-            freedMemory += pageSize;
-            currentAddress += pageSize; // Move to the next page
+// 4. WSClock: ages are in accesses of the owning process, so a process that does not run
+//    does not see its working set expire. A lap ends when the hand gets back to where the
+//    last eviction left it (hand positions only decrease when the hand wraps; that page may
+//    be gone, so a second wrap ends the lap too).
+size_t os::reclaimByWsClock(size_t sizeToFree, size_t scope) {
+    ReclaimHand& hand = clockOf(scope).front;
+    ReclaimHand lapStart = hand;
+    int wraps = 0;
+    size_t freedMemory = 0;
+    bool haveOldest = false;
+    size_t oldestProc = 0;
+    uint64_t oldestAge = 0;
+    PTE oldest;
+    PTE page;
+    while (freedMemory < sizeToFree) {
+        ReclaimHand before = hand;
+        if (!advanceHand(hand, scope, page)) {
+            break;
+        }
+        if (tie(hand.proc, hand.address) <= tie(before.proc, before.address)) {
+            wraps++;
+        }
+        process& proc = processes[hand.proc];
+        uint64_t& lastUse = proc.lastUse[page.vpn];
+        size_t victimProc = hand.proc;
+        bool evict = false;
+        if (proc.pageTable->testAndClearAccessed(page.vpn)) {
+            stats.reclaim_referenced++;
+            lastUse = proc.virtualTime;
+        } else if (proc.virtualTime - lastUse > reclaimConfig.wsWindow) {
+            evict = true;
+        } else if (!haveOldest || proc.virtualTime - lastUse > oldestAge) {
+            haveOldest = true;
+            oldestProc = hand.proc;
+            oldestAge = proc.virtualTime - lastUse;
+            oldest = page;
+        }
+        bool lapDone = wraps > 1 || (wraps == 1 && tie(hand.proc, hand.address) >= tie(lapStart.proc, lapStart.address));
+        if (!evict && lapDone) {
+            // a whole lap inside working sets; nothing was swapped out since oldest was seen
+            evict = haveOldest;
+            victimProc = oldestProc;
+            page = oldest;
+            lapStart = hand;
+            wraps = 0;
+        }
+        if (!evict) {
+            continue;
+        }
+        if (!swapOutPage(processes[victimProc], page.vpn, page.pfn, page.page_size)) {
+            break;
+        }
+        freedMemory += page.page_size;
+        lapStart = hand;
+        wraps = 0;
+        haveOldest = false;
+    }
+    return freedMemory;
+}
 
-            tlb.invalidate_tlb(proc.pid, vpn);
+// 5. aging: the register is shifted on every reclaim, so reclaim frequency sets the
+//    resolution. Ties go in address order.
+size_t os::reclaimByAge(size_t sizeToFree, size_t scope) {
+    vector<pair<size_t, PTE> > pages;
+    residentPages(scope, pages);
+    vector<uint8_t> ages(pages.size());
+    vector<size_t> order(pages.size());
+    for (size_t i = 0; i < pages.size(); i++) {
+        process& proc = processes[pages[i].first];
+        uint8_t& age = proc.pageAge[pages[i].second.vpn];
+        bool referenced = proc.pageTable->testAndClearAccessed(pages[i].second.vpn);
+        stats.reclaim_referenced += referenced;
+        age = (age >> 1) | (referenced ? 0x80 : 0);
+        ages[i] = age;
+        order[i] = i;
+    }
+    stable_sort(order.begin(), order.end(), [&ages](size_t a, size_t b) { return ages[a] < ages[b]; });
+    size_t freedMemory = 0;
+    for (size_t i : order) {
+        if (freedMemory >= sizeToFree) {
+            break;
+        }
+        const PTE& page = pages[i].second;
+        if (!swapOutPage(processes[pages[i].first], page.vpn, page.pfn, page.page_size)) {
+            break;
         }
+        freedMemory += page.page_size;
     }
+    return freedMemory;
 }
 
-void os::swapOutPage(uint32_t vpn, uint32_t pfnToSwapOut) {
-    if (pfnToSwapOut < memoryMap.size() && memoryMap[pfnToSwapOut]) {
-        //disk.push_back(pfnToSwapOut); // Store the page data on the disk
-        size_t diskBlock = findFreeDiskBlock();
-        if (diskBlock == -1) {
-            throw runtime_error("No free disk block found for swapping");
+// Called by allocations: free memory would drop below the low watermark.
+void os::reclaimBelowLowWatermark(size_t bytesToAllocate) {
+    size_t freeBytes = frameAllocator.freeBytes();
+    if (freeBytes >= low_watermark + bytesToAllocate) {
+        return;
+    }
+    if (kswapdThread.joinable()) {
+        {
+            lock_guard<mutex> guard(kswapdMutex);
+            kswapdRequested = true;
         }
+        kswapdWake.notify_one();
+    } else {
+        directReclaim(high_watermark + bytesToAllocate - freeBytes);
+    }
+}
 
-        diskMap[diskBlock] = true; // Mark the disk block as used
-        pageToDiskMap[vpn] = diskBlock; 
-        memoryMap[pfnToSwapOut] = false; // Free the page in physical memory
+void os::directReclaim(size_t sizeToFree) {
+    stats.direct_reclaims++;
+    swapOutToMeetWatermark(sizeToFree);
+}
 
-        // Update the map to reflect where the page is stored on disk
-        //pageToDiskMap[vpn] = disk.size() - 1;
+// kswapd: sleeps until woken, then reclaims in batches up to the high watermark, letting
+// the replay run between two batches. It gives up when nothing is left to swap out. A
+// failure ends the thread and is rethrown by stopKswapd().
+void os::kswapdMain() {
+    unique_lock<mutex> wake(kswapdMutex);
+    while (true) {
+        kswapdWake.wait(wake, [this] { return kswapdRequested || kswapdStopping; });
+        if (kswapdStopping) {
+            return;
+        }
+        wake.unlock();
+        lockExclusive();
+        stats.kswapd_wakeups++;
+        while (!kswapdStopping && frameAllocator.freeBytes() < high_watermark) {
+            size_t before = frameAllocator.freeBytes();
+            backgroundReclaim = true;
+            try {
+                swapOutToMeetWatermark(min<size_t>(high_watermark - before, size_t(reclaimConfig.batchPages) * minPageSize));
+            } catch (...) {
+                backgroundReclaim = false;
+                kswapdError = current_exception();
+                unlockMemory();
+                return;
+            }
+            backgroundReclaim = false;
+            if (frameAllocator.freeBytes() <= before) {
+                break;
+            }
+            unlockMemory();
+            this_thread::yield();
+            lockExclusive();
+        }
+        kswapdRequested = false;
+        unlockMemory();
+        wake.lock();
+    }
+}
+
+void os::stopKswapd() {
+    if (!kswapdThread.joinable()) {
+        return;
+    }
+    {
+        lock_guard<mutex> guard(kswapdMutex);
+        kswapdStopping = true;
+    }
+    kswapdWake.notify_one();
+    kswapdThread.join();
+    if (kswapdError) {
+        rethrow_exception(exchange(kswapdError, nullptr));
+    }
+}
 
-        // update present bit
-        runningProc->pageTable.updatePresentBit(vpn);
+bool os::swapOutPage(process& proc, uint64_t vpn, uint32_t pfnToSwapOut, uint32_t pageSize) {
+    if (!frameAllocator.isAllocated(pfnToSwapOut)) {
+        return false;
+    }
+    uint32_t slot = swapDevice.allocate(pageSize / SWAP_SLOT_SIZE);
+    if (slot == NO_SLOT) {
+        return false;
     }
-} 
+    writeSwapStamps(proc, vpn, slot, pageSize);
+    proc.swapSlots[vpn] = slot;
+    proc.pageTable->updatePresentBit(vpn);
+    invalidateTranslation(proc, vpn, pageSize);
+    frameAllocator.free(pfnToSwapOut); // Free the page in physical memory
+    uint32_t pages = pageSize / minPageSize;
 
-uint32_t os::findFreeDiskBlock() {
-    for (size_t i = 0; i < diskMap.size(); ++i) {
-        if (!diskMap[i]) {
-            return i;
+    // per-frame state does not survive the frame
+    proc.hugePageSegmentAccessMap.erase(pfnToSwapOut);
+    proc.sparseScans.erase(pfnToSwapOut);
+    pageSizeToSegmentCountMap.erase(pfnToSwapOut);
+    proc.lastUse.erase(vpn);
+    proc.pageAge.erase(vpn);
+
+    stats.swap_outs++;
+    if (backgroundReclaim) {
+        stats.kswapd_pages += pages;
+    } else {
+        // direct reclaim runs synchronously in the allocating process, which waits for the write
+        stats.direct_reclaim_pages += pages;
+        if (running()) {
+            stats.charge(running()->pid, coreIndex(), COST_SWAP, uint64_t(costModel.swap_write) * pages);
         }
     }
-    return -1;
+    return true;
 }
 
+// every 4KB block of a page on swap starts with its owner and vpn, checked when it comes back;
+// the rest of the block is never written, so a huge page costs no host memory and leaves the
+// swap file sparse
+struct SwapStamp {
+    int64_t pid;
+    uint64_t vpn;   // no padding: the stamp is compared bytewise
+};
 
+void os::writeSwapStamps(const process& proc, uint64_t vpn, uint32_t slot, uint32_t pageSize) {
+    for (uint32_t i = 0; i < pageSize / SWAP_SLOT_SIZE; i++) {
+        SwapStamp stamp{proc.pid, vpn + i};
+        swapDevice.write(slot + i, &stamp, sizeof(stamp));
+    }
+}
+
+bool os::checkSwapStamps(const process& proc, uint64_t vpn, uint32_t slot, uint32_t pageSize) {
+    for (uint32_t i = 0; i < pageSize / SWAP_SLOT_SIZE; i++) {
+        SwapStamp expected{proc.pid, vpn + i}, stored;
+        swapDevice.read(slot + i, &stored, sizeof(stored));
+        if (memcmp(&expected, &stored, sizeof(stored)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
 
 /*
 void handleTLBMiss(uint32_t virtualAddress) {
@@ -191,153 +718,544 @@ void handleTLBMiss(uint32_t virtualAddress) {
 }
 */
 
-uint32_t os::swapInPage(uint32_t vpn, uint32_t size) {
-    uint32_t diskBlock = pageToDiskMap[vpn];
-    diskMap[diskBlock] = false;
+uint32_t os::swapInPage(uint64_t vpn, uint32_t size) {
+    process& proc = *running();
+    auto slot = proc.swapSlots.find(vpn);
+    if (slot == proc.swapSlots.end()) {
+        throw logic_error("Swapping in a page that is not on swap");
+    }
+    uint32_t diskBlock = slot->second;
+    // frames first: making room may swap other pages out. The page keeps its slot until it
+    // is mapped again, so it is still on swap if no frame can be found.
     auto frames = findPhysicalFrames(size);
+
+    if (!checkSwapStamps(proc, vpn, diskBlock, size)) {
+        throw logic_error("Swap slot " + to_string(diskBlock) + " does not hold the page swapped out");
+    }
+
+    uint32_t pfn = frames[0].first;
+    uint64_t pageVpn = vpn;
     for (auto p : frames) {
-        auto pfn = p.first;
-        auto size = p.second;
-        runningProc->pageTable.setMapping(size, vpn, pfn);
-        vpn += size / minPageSize;
+        proc.pageTable->setMapping(p.second, vpn, p.first);
+        vpn += p.second / minPageSize;
     }
+    proc.swapSlots.erase(pageVpn);
+    swapDevice.free(diskBlock, size / SWAP_SLOT_SIZE);
+    stats.swap_ins++;
+    return pfn;
 }
 
-uint32_t os::findFreeFrame() {
-    for (uint32_t i = 0; i < memoryMap.size(); ++i) {
-        if (!memoryMap[i]) {
-            return i; 
-        }
+// Fault on a page the running process has on swap: read it back and map it (in smaller
+// pieces if no block of its size is free), pte becomes the translation of address.
+bool os::swapInFault(uint64_t address, PTE& pte) {
+    process& proc = *running();
+    if (!proc.swapSlots.count(pte.vpn)) {
+        return false;
     }
-    return -1; 
+    swapInPage(pte.vpn, pte.page_size);
+    return proc.pageTable->translate(address, pte) == WALK_OK;
+}
+
+uint32_t os::findFreeFrame() {
+    return frameAllocator.peekFree();
+}
+
+void os::handleInstruction(const string& instruction, uint64_t value, uint32_t pid) {
+    handleInstruction(opcodeFromName(instruction), value, pid);
 }
 
-void os::handleInstruction(const string& instruction, uint32_t value, uint32_t pid) {
-    uint32_t result;
-    if (instruction == "alloc") {
-      result = allocateMemory(value);
-    } else if (instruction == "free") {
+// Replay threads of replayOnCores() come with their core bound, a sequential replay picks
+// the core here.
+void os::handleInstruction(Opcode opcode, uint64_t value, uint32_t pid, uint32_t coreTag) {
+    struct MemoryLockRelease {
+        os* owner;
+        ~MemoryLockRelease() { owner->unlockMemory(); }
+    } release{this};
+    if (parallelReplay || kswapdThread.joinable()) {
+        if (opcode == OP_ACCESS_STACK || opcode == OP_ACCESS_HEAP || opcode == OP_ACCESS_CODE) {
+            lockShared();
+        } else {
+            lockExclusive();
+        }
+    }
+    if (!parallelReplay) {
+        selectCore(opcode, pid, coreTag);
+    }
+    if (!running() && opcode != OP_SWITCH) {
+        return;     // the core has not been given a process yet
+    }
+    switch (opcode) {
+    case OP_ALLOC:
+      allocateMemory(value);
+      break;
+    case OP_FREE:
       freeMemory(value);
-    } else if (instruction == "access_stak") {
-      result = accessStack(value);
-    } else if (instruction == "access_heap") {
-      result = accessHeap(value);
-    } else if (instruction == "access_code") {
-      result = accessCode(value);
-    } else if (instruction == "switch") {
+      break;
+    case OP_ACCESS_STACK:
+      accessStack(value);
+      break;
+    case OP_ACCESS_HEAP:
+      accessHeap(value);
+      break;
+    case OP_ACCESS_CODE:
+      accessCode(value);
+      break;
+    case OP_SWITCH:
       switchToProcess(pid);
+      break;
+    default:
+      break;
     }
 }
 
-int stack_miss = 0;
-int heap_miss = 0;
-int code_miss = 0;
-
-uint32_t os::accessStack(uint32_t address) {
-    // return accessMemory(address);
-    int temp = TLB_miss;
-    accessMemory(address);
-    if (temp != TLB_miss)
-        stack_miss++;
+WalkStatus os::accessStack(uint64_t address) {
+    return accessMemory(address, SEG_STACK);
 }
 
-uint32_t os::accessHeap(uint32_t address) {
-    // return accessMemory(address);
-    int temp = TLB_miss;
-    accessMemory(address);
-    if (temp != TLB_miss)
-        heap_miss++;
+WalkStatus os::accessHeap(uint64_t address) {
+    return accessMemory(address, SEG_HEAP);
 }
 
-uint32_t os::accessCode(uint32_t address) {
-    // return accessMemory(address);
-    int temp = TLB_miss;
-    accessMemory(address);
-    if (temp != TLB_miss)
-        code_miss++;
+WalkStatus os::accessCode(uint64_t address) {
+    return accessMemory(address, SEG_CODE);
 }
 
-void os::accessMemory(uint32_t address) {
-    memory_access_attempts++;
-    auto pte = runningProc->pageTable.translate(address);
-
+// MMU pipeline: l1 tlb, l2 tlb, then a page walk only when both miss.
+// Faults on swapped out pages (and on pages reclaimed by a huge page split) are served in
+// place and the access completes. Other failures come back as a status: WALK_NOT_PRESENT
+// for a page that is neither, WALK_INVALID for an unmapped address. Neither unwinds.
+// Every access is recorded in the stats breakdowns of its segment, process and page size,
+// together with its cycles under the cost model. Prefetch walks are off the critical path
+// and cost nothing.
+WalkStatus os::accessMemory(uint64_t address, Segment segment) {
+    Core& core = thisCore();
+    SimStats& counters = core.stats;
+    counters.memory_access_attempts++;
+    uint64_t clock = parallelReplay ? counters.memory_access_attempts : ++accessCount;
+    if (thpConfig.enabled && clock % thpConfig.scanInterval == 0) {
+        holdExclusive();
+        runKhugepaged();
+    }
+    if (tieringConfig.migrateInterval && clock % tieringConfig.migrateInterval == 0) {
+        holdExclusive();
+        migratePages();
+    }
+    process* proc = running();
+    AccessRecord record{uint32_t(proc->pid), coreIndex(), segment, STATS_MISS, 0, 0, false, false, -1, {}};
+    record.cycles[COST_L1_TLB] = costModel.l1_tlb;
+    uint32_t pfn, pageSize;
+    TlbLookupResult translation = core.tlb->lookup(address, proc->pid);
+    uint64_t vpn;
+    if (translation.hit()) {
+        record.level = translation.level == TLB_LEVEL_L1 ? STATS_L1 : STATS_L2;
+        if (record.level == STATS_L2) {
+            record.cycles[COST_L2_TLB] = costModel.l2_tlb;
+        }
+        pfn = translation.pfn;
+        pageSize = translation.page_size;
+        vpn = translation.vpn;
+    } else {
+        PTE pte;
+        uint64_t walkRefs = counters.memory_hit;
+        uint64_t pdeRefs = counters.walk_pde_refs;
+        uint64_t pteRefs = counters.walk_pte_refs;
+        WalkStatus status = walkPageTable(*proc, address, pte);
+        record.walkRefs = counters.memory_hit - walkRefs;
+        record.cycles[COST_L2_TLB] = costModel.l2_tlb;
+        record.cycles[COST_WALK_PDE] = (counters.walk_pde_refs - pdeRefs) * costModel.walk_pde;
+        record.cycles[COST_WALK_PTE] = (counters.walk_pte_refs - pteRefs) * costModel.walk_pte;
+        if (status == WALK_NOT_PRESENT && holdExclusive()) {
+            // another core may have served the fault (or unmapped the page) in between
+            proc = running();
+            status = proc->pageTable->translate(address, pte);
+        }
+        if (status == WALK_NOT_PRESENT) {
+            uint32_t faultPages = pte.page_size / minPageSize;
+            if (zeroFillFault(address, pte)) {
+                counters.page_faults++;
+                record.pageFault = true;
+                record.cycles[COST_PAGE_FAULT] = costModel.page_fault;
+                status = WALK_OK;
+            } else if (swapInFault(address, pte)) {
+                counters.page_faults++;
+                record.pageFault = true;
+                record.cycles[COST_PAGE_FAULT] = costModel.page_fault;
+                record.cycles[COST_SWAP] = uint64_t(costModel.swap_read) * faultPages;
+                status = WALK_OK;
+            }
+        }
+        if (status != WALK_OK) {
+            if (status == WALK_NOT_PRESENT) {
+                counters.page_faults++;
+                record.pageFault = true;
+                record.pageSize = pte.page_size;
+                record.cycles[COST_PAGE_FAULT] = costModel.page_fault;
+                record.cycles[COST_SWAP] = uint64_t(costModel.swap_read) * (pte.page_size / minPageSize);
+            } else {
+                counters.invalid_accesses++;
+                record.invalid = true;
+            }
+            counters.record(record);
+            return status;
+        }
+        core.tlb->fill(core.tlb->create_tlb_entry(pte.pfn, pte.page_size, pte.vpn, proc->pid));
+        if (core.prefetcher) {
+            prefetchAfterMiss(core, *proc, address, pte);
+        }
+        pfn = pte.pfn;
+        pageSize = pte.page_size;
+        vpn = pte.vpn;
+    }
+    record.pageSize = pageSize;
+    if (stackProfile) {
+        TranslationKey key{uint32_t(proc->pid), vpn};
+        stackProfile->l1.access(key);
+        stackProfile->l2.access(key);
+    }
     if (cacheChoice) {
-      if (pte.page_size >= HUGE_PAGE_SIZE) {
-        uint32_t numSegments = pte.page_size / minPageSize;
-        uint32_t hugePagePFN = pte.pfn;
+      if (pageSize >= HUGE_PAGE_SIZE) {
+        uint32_t numSegments = pageSize / minPageSize;
+        uint32_t hugePagePFN = pfn;
 
         // Only cache if the huge page is smaller than or equal to the cache
         if (numSegments <= Cache_Size) {
           CacheKeyHugePage key(hugePagePFN);
-          accessCacheHuge(key); // Cache the entire huge page
+          record.cacheResult = accessCacheHuge(key); // Cache the entire huge page
+          if (stackProfile) {
+              stackProfile->cacheHugePage.access(key);
+          }
         } else {
             // Increase cache miss if not caching the huge page
-            cacheMiss++;
+            counters.cache_miss++;
+            record.cacheResult = 0;
         }
       }
     } else {
-      if (pte.page_size >= HUGE_PAGE_SIZE) {
-        uint32_t numSegments = pte.page_size / minPageSize;
-        uint32_t hugePagePFN = pte.pfn;
+      if (pageSize >= HUGE_PAGE_SIZE) {
+        uint32_t hugePagePFN = pfn;
         uint32_t segmentOffset = (address % HUGE_PAGE_SIZE) / minPageSize; // 4 KB segment offset
         CacheKey4KB key(hugePagePFN, segmentOffset);
-        accessCache4KB(key);
-        pageSizeToSegmentCountMap[hugePagePFN] = numSegments;
-        runningProc->hugePageSegmentAccessMap[hugePagePFN][segmentOffset]++; // Increment access count by locating the subpage under the huge page
-        //because there are multiple access to one subpage in huge page
+        record.cacheResult = accessCache4KB(key);
+        if (stackProfile) {
+            stackProfile->cache4KB.access(key);
+        }
       }
     }
-    try {
-        auto addr = tlb.look_up(address, runningProc->pid);
-    } catch (const exception& e) {
-        auto tlbEntry = tlb.create_tlb_entry(pte.pfn, pte.page_size, address, runningProc->pid);
-        tlb.l1_insert(tlbEntry, 1);
-        tlb.l2_insert(tlbEntry, 1);
-        auto addr = tlb.look_up(address, runningProc->pid);
-    }
-}
-void os::accessCacheHuge(const CacheKeyHugePage& key) {
-    auto it = cacheHugePage.find(key);
-    if (it != cacheHugePage.end()) {
-        // Cache hit: Increment access frequency
-        cacheHit++;
-        it->second++;  // Increment frequency
+    // a process running on several cores shares its bookkeeping between their threads
+    unique_lock<mutex> bookkeeping(accessLocks[proc->pid % accessLocks.size()], defer_lock);
+    if (parallelReplay && lockHold == HOLD_SHARED) {
+        bookkeeping.lock();
+    }
+    if (pageSize >= HUGE_PAGE_SIZE) {
+        // per-subpage access counts of the huge page, consumed by khugepaged
+        map<uint32_t, uint32_t>& subpages = proc->hugePageSegmentAccessMap[pfn];
+        if (subpages.empty()) {
+            unique_lock<mutex> segmentCounts(segmentCountLock, defer_lock);
+            if (bookkeeping.owns_lock()) {
+                segmentCounts.lock();
+            }
+            pageSizeToSegmentCountMap[pfn] = pageSize / minPageSize;
+        }
+        subpages[(address >> 12) - vpn]++; // Increment access count by locating the subpage under the huge page
+        //because there are multiple access to one subpage in huge page
+    } else if (thpConfig.enabled) {
+        uint32_t regionPages = HUGE_PAGE_SIZE / minPageSize;
+        proc->regionAccessMap[(address >> 12) / regionPages].set((address >> 12) % regionPages);
+    }
+    if (tieringConfig.migrateInterval && clock % tieringConfig.sampleInterval == 0) {
+        proc->pageHeat[vpn]++;
+    }
+    proc->virtualTime++;
+    if (reclaimConfig.policy != RECLAIM_ADDRESS) {
+        proc->pageTable->markAccessed(vpn);
+    }
+    bookkeeping = unique_lock<mutex>();
+    if (record.cacheResult == 1) {
+        record.cycles[COST_DATA] = costModel.cache_hit;
     } else {
-        // Cache miss
-        cacheMiss++;
-        if (cacheHugePage.size() >= Cache_Size) {
-            // Evict the least frequently used entry
-            auto lfu = std::min_element(cacheHugePage.begin(), cacheHugePage.end(), 
-                [](const auto& a, const auto& b) { return a.second < b.second; });
-            if (lfu != cacheHugePage.end()) {
-                cacheHugePage.erase(lfu);
+        size_t tier = frameAllocator.tierOf(pfn);
+        counters.tiers[tier].accesses++;
+        record.cycles[COST_DATA] = frameAllocator.tier(tier).latency;
+    }
+    counters.record(record);
+    return WALK_OK;
+}
+
+// 1. khugepaged pass: demote sparse huge pages, then collapse the dense small-page regions
+//    touched since the last pass. Access counts start over afterwards. Page table walks of
+//    the daemon are software walks and are not counted as MMU references.
+void os::runKhugepaged() {
+    stats.thp_scans++;
+    for (process& proc : processes) {
+        map<uint32_t, uint32_t> stillSparse;
+        scanHugePages(proc, uint64_t(proc.code) + 1, proc.heap, stillSparse);
+        scanHugePages(proc, proc.stack, proc.pageTable->addressSpaceEnd(), stillSparse);
+        proc.sparseScans.swap(stillSparse);
+
+        uint32_t regionPages = HUGE_PAGE_SIZE / minPageSize;
+        for (const auto& region : proc.regionAccessMap) {
+            bool code = uint64_t(region.first) * regionPages * minPageSize <= proc.code;
+            if (!code && region.second.count() >= thpConfig.promoteThreshold * regionPages) {
+                promoteRegion(proc, region.first * regionPages);
             }
         }
-        // Add the new entry with an initial frequency of 1
-        cacheHugePage[key] = 1;
+        proc.regionAccessMap.clear();
+        proc.hugePageSegmentAccessMap.clear();
     }
 }
 
-void os::accessCache4KB(const CacheKey4KB& key) {
-    auto it = cache4KB.find(key);
-    if (it != cache4KB.end()) {
-        // Cache hit: Increment access frequency
-        cacheHit++;
-        it->second++;  // Increment frequency
-    } else {
-        // Cache miss
-        cacheMiss++;
-        if (cache4KB.size() >= Cache_Size) {
-            // Evict the least frequently used entry
-            auto lfu = std::min_element(cache4KB.begin(), cache4KB.end(), 
-                [](const auto& a, const auto& b) { return a.second < b.second; });
-            if (lfu != cache4KB.end()) {
-                cache4KB.erase(lfu);
+void os::scanHugePages(process& proc, uint64_t start, uint64_t end, map<uint32_t, uint32_t>& stillSparse) {
+    for (uint64_t address = start; address < end;) {
+        PTE page;
+        WalkStatus status = proc.pageTable->translate(address, page);
+        if (status == WALK_INVALID) {
+            address += minPageSize;
+            continue;
+        }
+        address = (uint64_t(page.vpn) << 12) + page.page_size;
+        if (status != WALK_OK || page.page_size < HUGE_PAGE_SIZE) {
+            continue;
+        }
+        auto touched = proc.hugePageSegmentAccessMap.find(page.pfn);
+        size_t touchedPages = touched == proc.hugePageSegmentAccessMap.end() ? 0 : touched->second.size();
+        if (touchedPages >= thpConfig.demoteThreshold * (page.page_size / minPageSize)) {
+            continue;
+        }
+        uint32_t sparse = proc.sparseScans.count(page.pfn) ? proc.sparseScans[page.pfn] + 1 : 1;
+        if (sparse < thpConfig.demoteScans) {
+            stillSparse[page.pfn] = sparse;
+        } else {
+            demoteHugePage(proc, page);
+        }
+    }
+}
+
+// 2. demotion: remap every subpage on its own frame, then give back the untouched ones
+void os::demoteHugePage(process& proc, const PTE& page) {
+    if (!frameAllocator.isAllocated(page.pfn)) {
+        return;
+    }
+    uint32_t numPages = page.page_size / minPageSize;
+    auto touched = proc.hugePageSegmentAccessMap.find(page.pfn);
+    frameAllocator.split(page.pfn);
+    for (uint32_t i = 0; i < numPages; i++) {
+        proc.pageTable->setMapping(minPageSize, page.vpn + i, page.pfn + i);
+    }
+    for (uint32_t i = 0; i < numPages; i++) {
+        if (touched != proc.hugePageSegmentAccessMap.end() && touched->second.count(i)) {
+            continue;
+        }
+        proc.pageTable->updatePresentBit(page.vpn + i);
+        frameAllocator.free(page.pfn + i);
+        proc.reclaimedPages.insert(page.vpn + i);
+        stats.thp_reclaimed_pages++;
+    }
+    invalidateTranslation(proc, page.vpn, page.page_size);
+    pageSizeToSegmentCountMap.erase(page.pfn);
+    stats.thp_demotions++;
+}
+
+// 3. promotion: every 4KB page of the region must belong to a smaller page inside it,
+//    either resident or reclaimed (pages on swap keep the region as it is)
+bool os::promoteRegion(process& proc, uint64_t regionVpn) {
+    uint32_t regionPages = HUGE_PAGE_SIZE / minPageSize;
+    uint64_t regionEnd = regionVpn + regionPages;
+    for (uint64_t v = regionVpn; v < regionEnd;) {
+        PTE page;
+        WalkStatus status = proc.pageTable->translate(v << 12, page);
+        if (status == WALK_INVALID ||
+            (status == WALK_NOT_PRESENT && !proc.reclaimedPages.count(v) && !proc.demandZeroPages.count(v))) {
+            return false;
+        }
+        if (page.page_size >= HUGE_PAGE_SIZE || page.vpn < regionVpn ||
+            page.vpn + page.page_size / minPageSize > regionEnd) {
+            return false;
+        }
+        v = page.vpn + page.page_size / minPageSize;
+    }
+    uint32_t pfn = frameAllocator.allocate(__builtin_ctz(regionPages));
+    if (pfn == NO_FRAME) {
+        stats.thp_promote_failed++;
+        return false;
+    }
+    for (uint64_t v = regionVpn; v < regionEnd;) {
+        PTE page;
+        if (proc.pageTable->translate(v << 12, page) == WALK_OK) {
+            frameAllocator.free(page.pfn);   // contents copied to the huge frame
+            stats.thp_copied_pages += page.page_size / minPageSize;
+        } else {
+            proc.reclaimedPages.erase(v);
+            proc.demandZeroPages.erase(v);
+        }
+        invalidateTranslation(proc, page.vpn, page.page_size);
+        v = page.vpn + page.page_size / minPageSize;
+    }
+    proc.pageTable->setMapping(HUGE_PAGE_SIZE, regionVpn, pfn);
+    stats.thp_promotions++;
+    return true;
+}
+
+// 4. zero-fill fault on a page given back by a split or allocated beyond free memory
+bool os::zeroFillFault(uint64_t address, PTE& pte) {
+    process& proc = *running();
+    uint64_t vpn = address >> 12;
+    bool reclaimed = proc.reclaimedPages.count(vpn);
+    if (!reclaimed && !proc.demandZeroPages.count(vpn)) {
+        return false;
+    }
+    // the page stays a fault to serve until it is mapped
+    uint32_t pfn = findPhysicalFrames(minPageSize)[0].first;
+    proc.pageTable->setMapping(minPageSize, vpn, pfn);
+    proc.reclaimedPages.erase(vpn);
+    proc.demandZeroPages.erase(vpn);
+    pte = PTE(vpn, pfn, minPageSize);
+    if (reclaimed) {
+        stats.thp_refaults++;
+    }
+    return true;
+}
+
+// 5. tier migration pass: promote the hottest pages of the slower tiers one tier up, hottest
+//    first, demoting the coldest pages of the tier above whenever it has no room. At most
+//    maxMigrations pages move per pass. Like khugepaged, the scan is a software walk.
+struct TierCandidate {
+    process* proc;
+    PTE page;
+    uint32_t heat;
+};
+
+void os::migratePages() {
+    stats.migration_passes++;
+    size_t tierCount = frameAllocator.tierCount();
+    vector<TierCandidate> hot;
+    vector<vector<TierCandidate> > cold(tierCount);
+    for (process& proc : processes) {
+        const uint64_t ranges[2][2] = {{0, proc.heap}, {proc.stack, proc.pageTable->addressSpaceEnd()}};
+        for (const auto& range : ranges) {
+            for (uint64_t address = range[0]; address < range[1];) {
+                PTE page;
+                WalkStatus status = proc.pageTable->translate(address, page);
+                if (status == WALK_INVALID) {
+                    address += minPageSize;
+                    continue;
+                }
+                address = (uint64_t(page.vpn) << 12) + page.page_size;
+                if (status != WALK_OK || !frameAllocator.isAllocated(page.pfn)) {
+                    continue;
+                }
+                auto it = proc.pageHeat.find(page.vpn);
+                uint32_t heat = it == proc.pageHeat.end() ? 0 : it->second;
+                size_t tier = frameAllocator.tierOf(page.pfn);
+                if (tier > 0 && heat >= tieringConfig.hotThreshold) {
+                    hot.push_back({&proc, page, heat});
+                } else if (tier + 1 < tierCount && heat <= tieringConfig.coldThreshold) {
+                    cold[tier].push_back({&proc, page, heat});
+                }
             }
         }
-        // Add the new entry with an initial frequency of 1
-        cache4KB[key] = 1;
     }
+    auto hotter = [](const TierCandidate& a, const TierCandidate& b) { return a.heat > b.heat; };
+    sort(hot.begin(), hot.end(), hotter);
+    for (vector<TierCandidate>& candidates : cold) {
+        // coldest at the back, popped first
+        sort(candidates.begin(), candidates.end(), hotter);
+    }
+
+    uint32_t budget = tieringConfig.maxMigrations;
+    for (const TierCandidate& candidate : hot) {
+        size_t target = frameAllocator.tierOf(candidate.page.pfn) - 1;
+        bool moved = false;
+        while (budget > 0 && !(moved = migratePage(*candidate.proc, candidate.page, target))) {
+            if (cold[target].empty()) {
+                break;
+            }
+            TierCandidate victim = cold[target].back();
+            cold[target].pop_back();
+            if (!migratePage(*victim.proc, victim.page, target + 1)) {
+                break;
+            }
+            budget--;
+        }
+        if (moved) {
+            budget--;
+        }
+        if (budget == 0) {
+            break;
+        }
+    }
+
+    for (process& proc : processes) {
+        for (auto it = proc.pageHeat.begin(); it != proc.pageHeat.end();) {
+            it->second /= 2;
+            it = it->second ? next(it) : proc.pageHeat.erase(it);
+        }
+    }
+}
+
+// copy the page, remap it and shoot down its translations; the copy runs at the bandwidth
+// of the slower of the two tiers and is charged to the page's owner
+bool os::migratePage(process& proc, const PTE& page, size_t tier) {
+    size_t from = frameAllocator.tierOf(page.pfn);
+    uint32_t pfn = frameAllocator.allocateIn(__builtin_ctz(page.page_size / minPageSize), tier);
+    if (pfn == NO_FRAME) {
+        return false;
+    }
+    frameAllocator.free(page.pfn);
+    proc.pageTable->setMapping(page.page_size, page.vpn, pfn);
+    invalidateTranslation(proc, page.vpn, page.page_size);
+
+    // state keyed by the frame follows the page
+    auto accesses = proc.hugePageSegmentAccessMap.find(page.pfn);
+    if (accesses != proc.hugePageSegmentAccessMap.end()) {
+        proc.hugePageSegmentAccessMap[pfn].swap(accesses->second);
+        proc.hugePageSegmentAccessMap.erase(page.pfn);
+    }
+    auto sparse = proc.sparseScans.find(page.pfn);
+    if (sparse != proc.sparseScans.end()) {
+        proc.sparseScans[pfn] = sparse->second;
+        proc.sparseScans.erase(page.pfn);
+    }
+    auto segments = pageSizeToSegmentCountMap.find(page.pfn);
+    if (segments != pageSizeToSegmentCountMap.end()) {
+        pageSizeToSegmentCountMap[pfn] = segments->second;
+        pageSizeToSegmentCountMap.erase(page.pfn);
+    }
+
+    TierCounters& counters = stats.tiers[tier];
+    if (tier < from) {
+        counters.promoted_in++;
+        stats.migration_promotions++;
+    } else {
+        counters.demoted_in++;
+        stats.migration_demotions++;
+    }
+    counters.migrated_bytes += page.page_size;
+    stats.migration_bytes += page.page_size;
+    double bandwidth = min(frameAllocator.tier(from).bandwidth, frameAllocator.tier(tier).bandwidth);
+    stats.charge(proc.pid, coreIndex(), COST_MIGRATION, uint64_t(ceil(page.page_size / bandwidth)));
+    return true;
+}
+
+bool os::accessCacheHuge(const CacheKeyHugePage& key) {
+    Core& core = thisCore();
+    bool hit = core.cacheHugePage->access(key);
+    if (hit) {
+        core.stats.cache_hit++;
+    } else {
+        core.stats.cache_miss++;
+    }
+    return hit;
+}
+
+bool os::accessCache4KB(const CacheKey4KB& key) {
+    Core& core = thisCore();
+    bool hit = core.cache4KB->access(key);
+    if (hit) {
+        core.stats.cache_hit++;
+    } else {
+        core.stats.cache_miss++;
+    }
+    return hit;
 }
 
 
@@ -346,60 +1264,210 @@ void os::switchToProcess(uint32_t pid) {
         return proc.pid == pid;
     });
 
+    Core& core = thisCore();
     if (it != processes.end()) {
         // Process found, switch to it
-        runningProc = &(*it);
-        tlb.l1_flush();
+        core.proc = it - processes.begin();
     } else {
         // Process not found, create a new one
         createProcess(pid);
-        runningProc = &processes.back();
+        core.proc = processes.size() - 1;
+    }
+    processes[core.proc].coreMask |= 1ull << coreIndex();
+    // l1 is flushed unless its entries are asid tagged, the profiled l1 with it
+    if (core.tlb->switch_process(pid) && stackProfile) {
+        stackProfile->l1.flush();
     }
 }
 
-vector<pair<uint32_t, uint32_t> > os::findPhysicalFrames(uint32_t size) {
-    size_t pagesNeeded = size / minPageSize;
-    size_t freePages = 0;
-    size_t start = 0;
-    vector<pair<uint32_t, uint32_t> > ret;
+uint32_t CorePlacement::place(Opcode opcode, uint32_t pid, uint32_t coreTag) {
+    if (coreTag) {
+        current = (coreTag - 1) % pids.size();
+    } else if (opcode == OP_SWITCH && pids.size() > 1) {
+        auto running = find(pids.begin(), pids.end(), int64_t(pid));
+        if (running != pids.end()) {
+            current = running - pids.begin();
+        } else {
+            current = next;
+            next = (next + 1) % pids.size();
+        }
+    }
+    if (opcode == OP_SWITCH) {
+        pids[current] = pid;
+    }
+    return current;
+}
 
-    // If only 4K pages are supported, uncomment this
-    /*
-    if (size != minPageSize) {
-        auto temp = findPhysicalFrames(size / 2);
-        ret.insert(ret.end(), temp.begin(), temp.end());
-        temp = findPhysicalFrames(size / 2);
-        ret.insert(ret.end(), temp.begin(), temp.end());
-        return ret;
-    }
-     */
-
-    for (size_t i = 0; i < memoryMap.size(); ++i) {
-        if (!memoryMap[i]) { // If the page is free
-            if (i % (size / minPageSize) != 0) {
-                continue;
-            }
-            if (freePages == 0) start = i;
-            freePages++;
-            if (freePages == pagesNeeded) {
-                for (size_t j = start; j < start + pagesNeeded; ++j) {
-                    memoryMap[j] = true;  // Mark pages as allocated
+void os::selectCore(Opcode opcode, uint32_t pid, uint32_t coreTag) {
+    currentCore = placement.place(opcode, pid, coreTag);
+}
+
+uint32_t os::coreIndex() const {
+    return parallelReplay ? boundCore : currentCore;
+}
+
+process* os::running() {
+    size_t proc = thisCore().proc;
+    return proc == NO_PROCESS ? nullptr : &processes[proc];
+}
+
+void os::lockShared() {
+    while (exclusiveWaiters.load(memory_order_relaxed)) {
+        this_thread::yield();
+    }
+    memoryLock.lock_shared();
+    lockHold = HOLD_SHARED;
+}
+
+void os::lockExclusive() {
+    exclusiveWaiters++;
+    memoryLock.lock();
+    exclusiveWaiters--;
+    lockHold = HOLD_EXCLUSIVE;
+}
+
+bool os::holdExclusive() {
+    if (lockHold != HOLD_SHARED) {
+        return false;
+    }
+    memoryLock.unlock_shared();
+    lockExclusive();
+    return true;
+}
+
+void os::unlockMemory() {
+    if (lockHold == HOLD_SHARED) {
+        memoryLock.unlock_shared();
+    } else if (lockHold == HOLD_EXCLUSIVE) {
+        memoryLock.unlock();
+    }
+    lockHold = HOLD_NONE;
+}
+
+void os::replayOnCores(TraceReader& trace) {
+    if (stackProfile) {
+        throw logic_error("Stack distances need a sequential replay");
+    }
+    CorePlacement recordPlacement(cores.size());
+    vector<vector<TraceRecord> > streams(cores.size());
+    // an untagged process stays on the core of its first record: split over two streams
+    // its allocs, frees and accesses would replay out of order
+    map<uint32_t, uint32_t> pinned;
+    while (const TraceRecord* record = trace.next()) {
+        uint32_t core = recordPlacement.place(Opcode(record->opcode), record->pid, record->core);
+        if (!record->core) {
+            core = pinned.emplace(record->pid, core).first->second;
+        }
+        streams[core].push_back(*record);
+    }
+
+    parallelReplay = true;
+    vector<exception_ptr> errors(cores.size());
+    vector<thread> threads;
+    for (uint32_t c = 0; c < cores.size(); c++) {
+        threads.emplace_back([this, &streams, &errors, c] {
+            boundCore = c;
+            try {
+                for (const TraceRecord& record : streams[c]) {
+                    handleInstruction(Opcode(record.opcode), record.value, record.pid, c + 1);
                 }
-                ret.push_back(make_pair(start, size));
-                return ret;
+            } catch (...) {
+                errors[c] = current_exception();
             }
-        } else {
-            freePages = 0;
+        });
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+    parallelReplay = false;
+    for (exception_ptr& error : errors) {
+        if (error) {
+            rethrow_exception(error);
         }
     }
-    if (size == minPageSize) {
-        throw runtime_error("Not enough memory to allocate");
-    } else {
-        auto temp = findPhysicalFrames(size / 2);
-        ret.insert(ret.end(), temp.begin(), temp.end());
-        temp = findPhysicalFrames(size / 2);
-        ret.insert(ret.end(), temp.begin(), temp.end());
-        return ret;
+}
+
+SimStats os::getStats() const {
+    SimStats merged = stats;
+    for (const Core& core : cores) {
+        merged += core.stats;
+    }
+    return merged;
+}
+
+void os::enableStackDistance() {
+    if (cores.size() > 1) {
+        throw logic_error("Stack distances need a single core: every core has tlbs of its own");
+    }
+    stackProfile.reset(new StackDistanceProfile());
+}
+
+// Huge pages larger than the cache are never inserted, so the cache curve only
+// profiles the pages that fit the configured cache size.
+void os::writeStackDistanceCurves(ostream& out) const {
+    if (!stackProfile) {
+        return;
     }
+    const ReuseHistogram& cache = cacheChoice ? stackProfile->cacheHugePage.result()
+                                              : stackProfile->cache4KB.result();
+    writeHitRateCurves(out, {{"l1_tlb", &stackProfile->l1.result()},
+                             {"l2_tlb", &stackProfile->l2.result()},
+                             {cacheChoice ? "cache_huge" : "cache_4kb", &cache}},
+                       {tlbConfig.l1_size, tlbConfig.l2_size, Cache_Size});
 }
 
+void os::reportPageTableUsage(ostream& out) const {
+    for (const process& proc : processes) {
+        out << "Page table bytes (pid " << proc.pid << "): "
+            << proc.pageTable->footprintBytes() << endl;
+    }
+}
+
+// Memory is overcommitted: when the request does not fit in the free frames, pages are
+// swapped out first to make room.
+vector<pair<uint32_t, uint32_t> > os::findPhysicalFrames(uint64_t size) {
+    vector<pair<uint32_t, uint32_t> > ret;
+    // a tail smaller than a page costs one frame, not one per power of two in it
+    size = (size + minPageSize - 1) & ~uint64_t(minPageSize - 1);
+    uint64_t needed = size;
+    if (frameAllocator.freeBytes() < needed) {
+        directReclaim(needed - frameAllocator.freeBytes());
+    }
+    if (kswapdThread.joinable()) {
+        reclaimBelowLowWatermark(needed);
+    }
+    // non power-of-two requests are served as their power-of-two pieces, largest first;
+    // the blocks taken are given back when the request cannot be served in full
+    try {
+        for (uint32_t bit = 63; size != 0; bit--) {
+            uint64_t piece = 1ull << bit;
+            if (size & piece) {
+                collectPhysicalFrames(piece, ret);
+                size &= ~piece;
+            }
+        }
+    } catch (...) {
+        for (auto p : ret) {
+            frameAllocator.free(p.first);
+        }
+        throw;
+    }
+    return ret;
+}
+
+// Ask the buddy allocator for one block of the requested size. When no block
+// of that order (or larger) is free, fall back to two blocks of half the size,
+// recursively down to 4KB, the same page sizes the old linear scan produced.
+void os::collectPhysicalFrames(uint64_t size, vector<pair<uint32_t, uint32_t> >& frames) {
+    int order = __builtin_ctzll(size) - __builtin_ctz(minPageSize);
+    uint32_t pfn = frameAllocator.allocate(order);
+    if (pfn != NO_FRAME) {
+        frames.push_back(make_pair(pfn, size));
+        return;
+    }
+    if (size == (uint64_t)minPageSize) {
+        throw runtime_error("Not enough memory to allocate");
+    }
+    collectPhysicalFrames(size / 2, frames);
+    collectPhysicalFrames(size / 2, frames);
+}
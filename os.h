@@ -1,9 +1,15 @@
 #ifndef OS_H
 #define OS_H
 
-#include "TwoLevelPageTable.h"
+#include "PageTable.h"
+#include "TieredMemory.h"
+#include "SwapDevice.h"
 #include "process.h"
 #include "tlb.h"
+#include "PageCache.h"
+#include "Trace.h"
+#include "Stats.h"
+#include "StackDistance.h"
 #include <iostream>
 #include <vector>
 #include <algorithm>
@@ -11,13 +17,15 @@
 #include <cstdint>
 #include <map>
 #include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <array>
+#include <condition_variable>
+#include <exception>
+#include <atomic>
 using namespace std;
 
-extern int memory_access_attempts;
-extern int stack_miss;
-extern int heap_miss;
-extern int code_miss;
-
 struct CacheKey4KB {
     uint32_t pfn;
     uint32_t offset;
@@ -27,6 +35,16 @@ struct CacheKey4KB {
     bool operator<(const CacheKey4KB& other) const {
         return std::tie(pfn, offset) < std::tie(other.pfn, other.offset);
     }
+
+    bool operator==(const CacheKey4KB& other) const {
+        return pfn == other.pfn && offset == other.offset;
+    }
+
+    struct Hash {
+        size_t operator()(const CacheKey4KB& key) const {
+            return std::hash<uint64_t>()((uint64_t(key.pfn) << 32) | key.offset);
+        }
+    };
 };
 
 // CacheKey for entire huge pages
@@ -38,55 +56,293 @@ struct CacheKeyHugePage {
     bool operator<(const CacheKeyHugePage& other) const {
         return pfn < other.pfn;
     }
+
+    bool operator==(const CacheKeyHugePage& other) const {
+        return pfn == other.pfn;
+    }
+
+    struct Hash {
+        size_t operator()(const CacheKeyHugePage& key) const {
+            return std::hash<uint32_t>()(key.pfn);
+        }
+    };
+};
+
+// LRU stack-distance profiles of one run (see StackDistance.h)
+//   l1:    translation stream, restarted on every context switch since l1 is flushed there
+//   l2:    translation stream of all processes, one shared LRU TLB
+//   cache: the key stream of the page cache selected by cacheChoice
+struct StackDistanceProfile {
+    StackDistanceProfiler<TranslationKey> l1;
+    StackDistanceProfiler<TranslationKey> l2;
+    StackDistanceProfiler<CacheKey4KB> cache4KB;
+    StackDistanceProfiler<CacheKeyHugePage> cacheHugePage;
+};
+
+// Transparent huge pages: a khugepaged-like scan runs every scanInterval accesses.
+//   demotion:  a huge page with fewer than demoteThreshold of its 4KB subpages touched in
+//              demoteScans scans in a row is split into 4KB mappings; the frames of untouched
+//              subpages are freed and zero-filled again on their next touch
+//   promotion: a HUGE_PAGE_SIZE-aligned region made of smaller pages with at least
+//              promoteThreshold of its 4KB pages touched since the last scan is collapsed
+//              into one huge page
+// The heap and stack are scanned; code is file backed and left alone.
+struct ThpConfig {
+    bool enabled = false;
+    uint32_t scanInterval = 65536;
+    double promoteThreshold = 0.75;
+    double demoteThreshold = 0.125;
+    uint32_t demoteScans = 2;
+};
+
+// Reclaim keeps free memory between the watermarks. Without kswapd it runs synchronously in
+// the allocating process (direct reclaim) down to the high watermark. With kswapd, dropping
+// below the low watermark wakes a background thread that swaps out batchPages pages at a
+// time until free memory is back above the high watermark, concurrently with the replay;
+// the allocating process only stalls in direct reclaim when memory runs out before kswapd
+// catches up. Background reclaim depends on thread timing, so such runs are not
+// reproducible to the access.
+//
+// Victims are picked by a policy over the resident pages. Every access sets the accessed bit
+// of its page in the page table; the clock hands sweep code and heap, then the stack, of one
+// process after the other (global scope) or of the process asking for memory only (local
+// scope, falling back to global when that process has nothing left). kswapd is always global.
+//   address: the first resident pages in address order, access history ignored
+//   clock:   second chance: a page found referenced has its bit cleared and is passed over
+//   clock2:  two-handed clock: the front hand clears bits, the back hand follows handSpread
+//            pages behind and takes the pages not referenced again in between
+//   wsclock: clock over the working set: an unreferenced page goes once its process made
+//            wsWindow accesses since it was last seen referenced; after a lap without such a
+//            page the oldest one goes
+//   lru:     LRU approximation by aging: each reclaim shifts the accessed bit into an 8-bit
+//            age per resident page, then takes the pages with the lowest age
+enum ReclaimPolicy {
+    RECLAIM_ADDRESS,
+    RECLAIM_CLOCK,
+    RECLAIM_CLOCK2,
+    RECLAIM_WSCLOCK,
+    RECLAIM_LRU
+};
+
+struct ReclaimConfig {
+    bool kswapd = false;
+    uint32_t batchPages = 32;
+    ReclaimPolicy policy = RECLAIM_CLOCK;
+    bool local = false;
+    uint32_t handSpread = 256;
+    uint64_t wsWindow = 65536;
 };
 
+// One simulated cpu: its own tlbs (l1, l2, prefetch buffer and page-walk cache), tlb
+// prefetcher and page cache, the counters of the accesses it makes, and the process it
+// runs, as an index in os::processes (which moves when it grows). Physical memory, swap and
+// the page tables are shared by all cores.
+const size_t NO_PROCESS = SIZE_MAX;
+const uint32_t MAX_CORES = 64;   // a process's cores are a 64-bit mask
 
+struct Core {
+    unique_ptr<Tlb> tlb;
+    unique_ptr<TlbPrefetcher> prefetcher;   // nullptr when tlbConfig.prefetcher is none
+    vector<uint64_t> prefetchCandidates;
+    unique_ptr<PageCache<CacheKey4KB>> cache4KB; //keyed on pfn & offset so we know which 4kb segment it is
+    unique_ptr<PageCache<CacheKeyHugePage>> cacheHugePage;
+    SimStats stats;                         // merged into the os stats by os::getStats()
+    size_t proc = NO_PROCESS;
+};
+
+// Records of a multi-core trace name their core; untagged records run on the core of the
+// last switch, and an untagged switch goes to the core already running the process, or
+// else to the next core round robin.
+class CorePlacement {
+private:
+    vector<int64_t> pids;    // process each core runs, -1 before its first switch
+    uint32_t current = 0;    // core of the last record
+    uint32_t next = 0;       // round robin cursor of untagged switches
+
+public:
+    explicit CorePlacement(uint32_t cores) : pids(cores, -1) {}
+    // core the record runs on
+    uint32_t place(Opcode opcode, uint32_t pid, uint32_t coreTag);
+};
+
+// Tiered memory (see TieringConfig): accesses are sampled into a per-page heat count.
+// Every migrateInterval accesses the hot pages of slower tiers move up one tier; when
+// the tier above is full, its coldest pages move down to make room. Heat is halved
+// after each pass so it tracks recent behaviour.
 class os {
 private:
     int minPageSize;
+    int addressBits;            // width of virtual addresses, see makePageTable()
     //process* runningProc;
     uint32_t HUGE_PAGE_SIZE = 128 * 4096;
-    uint32_t Cache_Size = 512;
-    vector<bool> memoryMap;
+    uint32_t Cache_Size;
+    TieredMemory frameAllocator;
     vector<process> processes;
-    vector<bool> diskMap;
-    uint32_t high_watermark;
-    uint32_t low_watermark;
-    uint32_t totalFreeSize;
-    //std::vector<uint32_t> disk;
-    map<uint32_t, uint32_t> pageToDiskMap;
-    Tlb tlb;
+    SwapDevice swapDevice;
+    size_t high_watermark;
+    size_t low_watermark;
+    ReclaimConfig reclaimConfig;
+    SimStats stats;
+    vector<Core> cores;
+    CorePlacement placement;
+    uint32_t currentCore = 0;   // core replaying the current record, sequential replay
+    TlbConfig tlbConfig;
+    CostModel costModel;
+    ThpConfig thpConfig;
+    TieringConfig tieringConfig;
+    unique_ptr<StackDistanceProfile> stackProfile;
+    uint64_t accessCount = 0;   // accesses of a sequential replay: the clock of the daemons
+
+    // page walk through the page-walk cache of the current core, its references counted in
+    // the core's memory_hit
+    WalkStatus walkPageTable(const process& proc, uint64_t vaddr, PTE& pte);
+    // after a demand miss on address (translated by pte), walk and install the prefetcher's candidates
+    void prefetchAfterMiss(Core& core, process& proc, uint64_t address, const PTE& pte);
+
+    // transparent huge pages
+    void runKhugepaged();
+    // demote the sparse huge pages of proc in [start, end), collecting the ones still waiting
+    void scanHugePages(process& proc, uint64_t start, uint64_t end, map<uint32_t, uint32_t>& stillSparse);
+    void demoteHugePage(process& proc, const PTE& page);
+    bool promoteRegion(process& proc, uint64_t regionVpn);
+    // fault on a 4KB page without a frame (reclaimed by a split or demand-zero): map a fresh frame,
+    // false for other faults
+    bool zeroFillFault(uint64_t address, PTE& pte);
+
+    // swap: fault a swapped out page back in, false when pte is not a page on swap
+    bool swapInFault(uint64_t address, PTE& pte);
+    // stamps of the page written to and checked on swap, one at the start of every slot
+    void writeSwapStamps(const process& proc, uint64_t vpn, uint32_t slot, uint32_t pageSize);
+    bool checkSwapStamps(const process& proc, uint64_t vpn, uint32_t slot, uint32_t pageSize);
+
+    // memoryLock orders the replay threads and kswapd; it is only taken while kswapd runs or
+    // the replay is parallel. An access holds it shared: it only changes state of its core
+    // and, under the access lock of its process, that process's access bookkeeping. Every
+    // other record, a fault and the daemons hold it exclusively; an access that needs to
+    // drops its shared hold and waits for an exclusive one. Threads waiting for an exclusive
+    // hold keep new shared holders out, so reclaim and faults are not starved by accesses.
+    shared_mutex memoryLock;
+    atomic<uint32_t> exclusiveWaiters{0};
+    bool parallelReplay = false;            // set while replayOnCores() runs
+    array<mutex, 64> accessLocks;           // by pid, access bookkeeping under a shared hold
+    mutex segmentCountLock;                 // pageSizeToSegmentCountMap under a shared hold
+    void lockShared();
+    void lockExclusive();
+    // make sure the calling thread holds memoryLock exclusively, if it is taken at all;
+    // true when a shared hold had to be given up (state may have changed in between)
+    bool holdExclusive();
+    void unlockMemory();
+    // core the calling thread replays, and the process running there (nullptr before the
+    // core's first switch)
+    uint32_t coreIndex() const;
+    Core& thisCore() { return cores[coreIndex()]; }
+    process* running();
+
+    // reclaim
+    mutex kswapdMutex;                      // kswapdRequested and kswapdStopping, for kswapdWake
+    condition_variable kswapdWake;
+    atomic<bool> kswapdRequested{false};
+    atomic<bool> kswapdStopping{false};
+    bool backgroundReclaim = false;   // set while kswapd holds memoryLock and swaps pages out
+    thread kswapdThread;
+    exception_ptr kswapdError;
+    void kswapdMain();
+    // wake kswapd, or reclaim synchronously up to the high watermark without it
+    void reclaimBelowLowWatermark(size_t bytesToAllocate);
+    // swap out sizeToFree bytes now, in the process asking for memory
+    void directReclaim(size_t sizeToFree);
+
+    // victim selection; scope is a process index, processes.size() for every process.
+    // Each returns the bytes swapped out
+    size_t memoryPages = 0;             // 4KB frames of physical memory, bounds a clock2 pass
+    ReclaimClock reclaimClock;          // hands of global reclaim
+    size_t reclaimPages(size_t sizeToFree, size_t scope);
+    size_t reclaimByAddress(size_t sizeToFree, size_t scope);
+    size_t reclaimByClock(size_t sizeToFree, size_t scope);
+    size_t reclaimByTwoHandedClock(size_t sizeToFree, size_t scope);
+    size_t reclaimByWsClock(size_t sizeToFree, size_t scope);
+    size_t reclaimByAge(size_t sizeToFree, size_t scope);
+    ReclaimClock& clockOf(size_t scope);
+    // move hand to the next resident page of scope, wrapping around; false if there is none
+    bool advanceHand(ReclaimHand& hand, size_t scope, PTE& page);
+    // resident pages of scope in address order, as (process index, page)
+    void residentPages(size_t scope, vector<pair<size_t, PTE> >& pages);
+
+    // multi-core, sequential replay: make the core of the record current
+    void selectCore(Opcode opcode, uint32_t pid, uint32_t coreTag);
+    // tlb shootdowns: invalidations made between begin and end are sent as one round
+    uint32_t shootdownBatches = 0;
+    uint64_t pendingShootdown = 0;   // remote cores of the round being gathered
+    void beginShootdownBatch() { shootdownBatches++; }
+    void endShootdownBatch();
+    void sendShootdown();
+
+    // tier migration
+    void migratePages();
+    // move page to a frame of tier, false if the tier has no free block of its size
+    bool migratePage(process& proc, const PTE& page, size_t tier);
 
 
 public:
-    os(size_t memorySize, size_t diskSize, uint32_t high_watermarkGiven, uint32_t low_watermarkGiven, bool cacheChoice);
+    // addressBits: 32 (two-level page tables, at most 4GB of memory) or 48 / 57 (4 / 5-level
+    // radix page tables, memory up to 8TB)
+    os(size_t memorySize, size_t diskSize, size_t high_watermarkGiven, size_t low_watermarkGiven, bool cacheChoice,
+       const TlbConfig& tlbConfig = TlbConfig(), const CacheConfig& cacheConfig = CacheConfig(),
+       const CostModel& costModel = CostModel(), const ThpConfig& thpConfig = ThpConfig(),
+       const TieringConfig& tieringConfig = TieringConfig(), const string& swapDirectory = string(),
+       const ReclaimConfig& reclaimConfig = ReclaimConfig(), uint32_t numCores = 1, int addressBits = 32);
     ~os();
     bool cacheChoice;
-    process* runningProc;
-    uint32_t cacheHit;
-    uint32_t cacheMiss;
     map<uint32_t, map<uint32_t, uint32_t>> hugePageSegmentAccessMap;
     map<uint32_t, uint32_t> pageSizeToSegmentCountMap; //stores the pfn of the huge page to number of 4kb subpages in it.
-    map<CacheKey4KB, uint32_t> cache4KB;
-    map<CacheKeyHugePage, uint32_t> cacheHugePage; //stores pfn & offset to freq so we know which 4kb segment it is
-    uint32_t allocateMemory(uint32_t size);
-    void freeMemory(uint32_t baseAddress);
+    uint64_t allocateMemory(uint64_t size);
+    void freeMemory(uint64_t baseAddress);
+    // drop the translation of proc's page at vpn from every core that may cache it
+    void invalidateTranslation(process& proc, uint64_t vpn, uint32_t pageSize = 4096);
     uint32_t createProcess(long int pid);
-    void accessCacheHuge(const CacheKeyHugePage& key);
-    void accessCache4KB(const CacheKey4KB& key);
+    // page cache of the current core, return true on a cache hit
+    bool accessCacheHuge(const CacheKeyHugePage& key);
+    bool accessCache4KB(const CacheKey4KB& key);
     //void destroyProcess(long int pid);
-    void swapOutToMeetWatermark(uint32_t sizeTobeFree);
-    void swapOutPage(uint32_t vpn, uint32_t pfn);
-    uint32_t swapInPage(uint32_t vpn, uint32_t size);
+    void swapOutToMeetWatermark(size_t sizeTobeFree);
+    // writes the page of proc to swap and frees its frame, charged to the running process
+    // (reclaim runs synchronously in the process that needs memory); false if swap is full
+    bool swapOutPage(process& proc, uint64_t vpn, uint32_t pfn, uint32_t pageSize = 4096);
+    // reads the swapped out page of the running process starting at vpn back into memory,
+    // returns the pfn mapped at vpn
+    uint32_t swapInPage(uint64_t vpn, uint32_t size);
     uint32_t findFreeFrame();
-    void handleInstruction(const string& string, uint32_t value, uint32_t pid);
-    uint32_t accessStack(uint32_t baseAddress);
-    uint32_t accessHeap(uint32_t baseAddress);
-    uint32_t accessCode(uint32_t baseAddress);
-    void accessMemory(uint32_t baseAddress);
+    void handleInstruction(const string& string, uint64_t value, uint32_t pid);
+    // coreTag: 1 + the core the record runs on, 0 for untagged records (see TraceRecord)
+    void handleInstruction(Opcode opcode, uint64_t value, uint32_t pid, uint32_t coreTag = 0);
+    // Parallel replay: the records are placed on their cores first, then every core replays
+    // its own on a thread of its own. Untagged records are not rescheduled: every process
+    // runs on the core its first record was placed on. Cores only wait for each other through memoryLock, so
+    // the records of different cores interleave differently from run to run (the daemons
+    // run every interval accesses of each core, which keeps their rate). Throws the first
+    // error a core ran into once every thread is done.
+    void replayOnCores(TraceReader& trace);
+    WalkStatus accessStack(uint64_t baseAddress);
+    WalkStatus accessHeap(uint64_t baseAddress);
+    WalkStatus accessCode(uint64_t baseAddress);
+    WalkStatus accessMemory(uint64_t baseAddress, Segment segment);
     void switchToProcess(uint32_t pid);
-    vector<pair<uint32_t, uint32_t> > findPhysicalFrames(uint32_t size);
-    uint32_t findFreeDiskBlock();
+    void reportPageTableUsage(ostream& out) const;
+    // the os counters plus those of every core
+    SimStats getStats() const;
+    // stop and join kswapd (called after the replay, before reading the stats), rethrowing
+    // the error that ended it, if any
+    void stopKswapd();
+
+    // start recording stack distances of the translation and cache key streams, throws
+    // logic_error with more than one core
+    void enableStackDistance();
+    // nullptr unless enabled
+    const StackDistanceProfile* getStackDistance() const { return stackProfile.get(); }
+    // LRU hit rate curves of l1, l2 and the page cache as CSV
+    void writeStackDistanceCurves(ostream& out) const;
+    vector<pair<uint32_t, uint32_t> > findPhysicalFrames(uint64_t size);
+    void collectPhysicalFrames(uint64_t size, vector<pair<uint32_t, uint32_t> >& frames);
 };
 
 #endif // OS_H
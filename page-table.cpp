@@ -2,112 +2,209 @@
 #include <vector>
 #include <cstdint>
 #include <map>
+#include <algorithm>
+#include <stdexcept>
 #include "TwoLevelPageTable.h"
+#include "RadixPageTable.h"
 
 
 using namespace std;
 
-PTE::PTE(uint32_t vpn, uint32_t pfn, uint32_t page_size): vpn(vpn), pfn(pfn), page_size(page_size),
+PTE::PTE(uint64_t vpn, uint32_t pfn, uint32_t page_size): vpn(vpn), pfn(pfn), page_size(page_size),
     present(true), valid(true) {}
 
-PTE::PTE(): present(false), valid(false) {}
+PTE::PTE(): vpn(0), pfn(0), page_size(0), present(false), valid(false) {}
 
-int memory_hit = 0;
 const int pdeOffset = 10;   // assuming VPN is 20 bits and PDE & PTE index are 10 bits
 const uint32_t tenBitsMask = 0b1111111111;
 const uint32_t minPageSize = 4096;
 
+// first vpn of the directory slot after the one holding vpn: pages are split into
+// pieces at these boundaries
+static inline uint32_t nextDirectorySlot(uint32_t vpn) {
+    return (vpn | tenBitsMask) + 1;
+}
+
+unique_ptr<PageTable> makePageTable(int pid, int addressBits) {
+    if (addressBits == 32) {
+        return make_unique<TwoLevelPageTable>(pid);
+    }
+    if (addressBits == 48 || addressBits == 57) {
+        return make_unique<RadixPageTable>(pid, (addressBits - 12) / 9);
+    }
+    throw invalid_argument("Virtual addresses must be 32, 48 or 57 bits wide");
+}
+
 // 1. constructor
 //    input: pid
-//    initialize page table，mapToPDEs
+//    the directory starts empty, PTE pages are allocated on first mapping
 TwoLevelPageTable::TwoLevelPageTable(int pidGiven) {
     pid = pidGiven;
-    for (uint32_t vpnPdeBits = 0; vpnPdeBits <= 0b1111111111; vpnPdeBits++) {
-        mapToPDEs[vpnPdeBits] = map<uint32_t, PTE>();
+}
+
+// a leaf covers its whole directory slot; a span start is valid up to the end of its page
+PackedPTE TwoLevelPageTable::lookup(uint64_t vpn) const {
+    if (vpn >> (virtualMemBits - 12)) {
+        return 0;
     }
+    uint32_t pdeIdx = vpn >> pdeOffset;
+    PackedPTE leaf = Encoding::load(leaves[pdeIdx]);
+    if (leaf) {
+        return leaf + (vpn & tenBitsMask);
+    }
+    const PTEPage* ptePage = directory[pdeIdx].get();
+    return ptePage ? ptePage->covering(vpn) : 0;
 }
 
 
 // 2. setMapping
 //    input: pageSize, vpn, pfn
-void TwoLevelPageTable::setMapping(uint32_t pageSize, uint32_t vpn, uint32_t pfn) {
-    uint32_t numPTEs = pageSize / minPageSize;
-    uint32_t numPDEs = numPTEs / 1024 + (numPTEs % 1024 == 0? 0: 1);
-    uint32_t pdeIdx = vpn >> pdeOffset;
-
-    for (uint32_t i = pdeIdx; i < pdeIdx + numPDEs; i++) {
-        auto& mapToPte = mapToPDEs[pdeIdx]; //presentBit, validBit, ptePfn
-        uint32_t pteIdx = vpn & tenBitsMask;
-        for (uint32_t j = pteIdx; j < pteIdx + numPTEs; j++) {
-                mapToPte.insert_or_assign(j, PTE(vpn, pfn, pageSize));
+//    pfn must be aligned to pageSize (buddy allocator blocks are)
+//    pages already mapped in the range are unmapped first; then one entry is written per
+//    piece: a leaf PDE per directory slot for a directory-aligned page of 4MB or more,
+//    otherwise a span start in each PTE page the page touches
+void TwoLevelPageTable::setMapping(uint32_t pageSize, uint64_t vpnGiven, uint32_t pfn) {
+    uint32_t numPages = pageSize / minPageSize;
+    if (vpnGiven + numPages > (1ull << (virtualMemBits - 12))) {
+        throw out_of_range("Mapping beyond the 32-bit address space");
+    }
+    uint32_t vpn = vpnGiven;
+    uint32_t end = vpn + numPages;
+    bool leaf = numPages >= (1u << pdeOffset) && (vpn & tenBitsMask) == 0;
+    unmapOverlapping(vpn, numPages);
+
+    for (uint32_t v = vpn; v < end; v = nextDirectorySlot(v)) {
+        uint32_t pdeIdx = v >> pdeOffset;
+        if (leaf) {
+            leaves[pdeIdx] = Encoding::piece(v, vpn, pfn, pageSize);
+            continue;
+        }
+        auto& ptePage = directory[pdeIdx];
+        if (!ptePage) {
+            ptePage = make_unique<PTEPage>();
+            ptePages++;
         }
+        ptePage->addStart(v & tenBitsMask, Encoding::piece(v, vpn, pfn, pageSize));
+        liveEntries[pdeIdx] += min(end, nextDirectorySlot(v)) - v;
     }
 }
 
 // 3. translate
 //    input: virtual address
-//    output: pte
-PTE TwoLevelPageTable::translate(uint32_t vaddr) {
-    uint32_t vpn = vaddr >> 12;
-    auto& mapToPte = mapToPDEs[vpn >> pdeOffset];
+//    output: walk status, pte
+//    a directory read, a PTE read and a bitmap scan, never allocates or throws
+WalkStatus TwoLevelPageTable::translate(uint64_t vaddr, PTE& pte) const {
+    uint64_t vpn = vaddr >> 12;
+    PackedPTE bits = lookup(vpn);
+    if (!bits) {
+        return WALK_INVALID;
+    }
+    pte = Encoding::unpack(bits, vpn);
 
-    uint32_t pteIdx = vpn & tenBitsMask;
-    PTE pte = mapToPte[pteIdx];
-    memory_hit += 2;
+    if (!pte.present) {
+        // the OS decides how to service the fault
+        return WALK_NOT_PRESENT;
+    }
+    return WALK_OK;
+}
 
-    if (!pte.valid) {
-        throw runtime_error("Valid bit of pte is 0.");
+void TwoLevelPageTable::unmapOverlapping(uint32_t vpn, uint32_t numPages) {
+    uint32_t end = vpn + numPages;
+    for (uint32_t v = vpn; v < end; v = nextDirectorySlot(v)) {
+        uint32_t pdeIdx = v >> pdeOffset;
+        // the page covering the start of the piece, then every page starting inside it
+        PackedPTE covering = lookup(v);
+        if (covering) {
+            PTE page = Encoding::unpack(covering, v);
+            unmapPage(page.vpn, page.page_size / minPageSize);
+        }
+        uint32_t lastSlot = (min(end, nextDirectorySlot(v)) - 1) & tenBitsMask;
+        PTE page;
+        while (directory[pdeIdx] && directory[pdeIdx]->lastStartIn(v, lastSlot, page)) {
+            unmapPage(page.vpn, page.page_size / minPageSize);
+        }
     }
-    if (!pte.present) {
-        // TODO: Call OS swap in method
-        // Done
-//        os.swapInPage(vpn, pte.page_size);
-//        pte = mapToPte[pteIdx];
-//        memory_hit += 2;
-        //throw runtime_error("Present bit of pte is 0.");
-        throw logic_error("Present bit of pte is 0.");
+}
+
+// clear every piece of the page, dropping PTE pages that become empty
+void TwoLevelPageTable::unmapPage(uint32_t pageVpn, uint32_t numPages) {
+    uint32_t end = pageVpn + numPages;
+    for (uint32_t v = pageVpn; v < end; v = nextDirectorySlot(v)) {
+        uint32_t pdeIdx = v >> pdeOffset;
+        if (leaves[pdeIdx]) {
+            leaves[pdeIdx] = 0;
+            continue;
+        }
+        auto& ptePage = directory[pdeIdx];
+        if (!ptePage) {
+            continue;
+        }
+        ptePage->removeStart(v & tenBitsMask);
+        liveEntries[pdeIdx] -= min(end, nextDirectorySlot(v)) - v;
+        if (liveEntries[pdeIdx] == 0) {
+            ptePage.reset();
+            ptePages--;
+        }
     }
-    return pte;
 }
 
 // 4. free
-//    remove mapping given vpn
-void TwoLevelPageTable::free(uint32_t vpn) {
-    uint32_t firstPteIdx = vpn & tenBitsMask;
-    auto first = mapToPDEs[vpn >> pdeOffset][firstPteIdx];
-    if (!first.valid) {
+//    remove the page containing vpn
+void TwoLevelPageTable::free(uint64_t vpn) {
+    PackedPTE bits = lookup(vpn);
+    if (!bits) {
         return;
     }
-    uint32_t numPTEs = first.page_size / minPageSize;
-    uint32_t numPDEs = numPTEs / 1024 + (numPTEs % 1024 == 0? 0: 1);
-    uint32_t pdeIdx = vpn >> pdeOffset;
+    PTE page = Encoding::unpack(bits, vpn);
+    unmapPage(page.vpn, page.page_size / minPageSize);
+}
 
-    for (uint32_t i = pdeIdx; i < pdeIdx + numPDEs; i++) {
-        auto& mapToPte = mapToPDEs[pdeIdx]; //presentBit, validBit, ptePfn
-        uint32_t pteIdx = vpn & tenBitsMask;
-        for (uint32_t j = pteIdx; j < pteIdx + numPTEs; j++) {
-            mapToPte.erase(j);
+//5.update present bit when swap out
+//  one entry per piece of the page containing vpn
+void TwoLevelPageTable::updatePresentBit(uint64_t vpn) {
+    PackedPTE bits = lookup(vpn);
+    if (!bits) {
+        return;
+    }
+    PTE page = Encoding::unpack(bits, vpn);
+    uint32_t end = page.vpn + page.page_size / minPageSize;
+    for (uint32_t v = page.vpn; v < end; v = nextDirectorySlot(v)) {
+        uint32_t pdeIdx = v >> pdeOffset;
+        if (leaves[pdeIdx]) {
+            leaves[pdeIdx] &= ~Encoding::presentBit;
+        } else if (PTEPage* ptePage = directory[pdeIdx].get()) {
+            ptePage->entries[v & tenBitsMask] &= ~Encoding::presentBit;
         }
     }
 }
 
-//5.update present bit when swap out
-void TwoLevelPageTable::updatePresentBit(uint32_t vpn) {
-    uint32_t firstPteIdx = vpn & tenBitsMask;
-    auto first = mapToPDEs[vpn >> pdeOffset][firstPteIdx];
-    uint32_t numPTEs = first.page_size / minPageSize;
-    uint32_t numPDEs = numPTEs / 1024 + (numPTEs % 1024 == 0? 0: 1);
-    uint32_t pdeIdx = vpn >> pdeOffset;
-
-    for (uint32_t i = pdeIdx; i < pdeIdx + numPDEs; i++) {
-        auto& mapToPte = mapToPDEs[pdeIdx]; //presentBit, validBit, ptePfn
-        uint32_t pteIdx = vpn & tenBitsMask;
-        for (uint32_t j = pteIdx; j < pteIdx + numPTEs; j++) {
-            mapToPte[j].present = false;
-        }
+//6.accessed bit
+//  a page has one bit, in its first piece: a leaf PDE or the span start
+PackedPTE* TwoLevelPageTable::firstPieceEntry(uint64_t vpn) {
+    PackedPTE bits = lookup(vpn);
+    if (!bits) {
+        return nullptr;
+    }
+    uint32_t pageVpn = Encoding::unpack(bits, vpn).vpn;
+    uint32_t pdeIdx = pageVpn >> pdeOffset;
+    if (leaves[pdeIdx]) {
+        return &leaves[pdeIdx];
     }
+    return &directory[pdeIdx]->entries[pageVpn & tenBitsMask];
 }
 
+void TwoLevelPageTable::markAccessed(uint64_t vpn) {
+    Encoding::markAccessed(firstPieceEntry(vpn));
+}
+
+bool TwoLevelPageTable::testAndClearAccessed(uint64_t vpn) {
+    return Encoding::testAndClearAccessed(firstPieceEntry(vpn));
+}
+
+//7.page table memory footprint in bytes
+size_t TwoLevelPageTable::footprintBytes() const {
+    return sizeof(directory) + sizeof(leaves) + sizeof(liveEntries) + ptePages * sizeof(PTEPage);
+}
 
 //for testing
 
@@ -1,25 +1,25 @@
 // process.cpp
 #include "process.h"
-#include "TwoLevelPageTable.h"
+#include "PageTable.h"
 #include <iostream>
 
 using namespace std;
 
-process::process(long int pidGiven) : pageTable(TwoLevelPageTable(pid)), pid(pidGiven), size(0), heapPages(0), code(0), stack(0), heap(code) {}
+process::process(long int pidGiven, int addressBits) : pageTable(makePageTable(pidGiven, addressBits)), pid(pidGiven), size(0), heapPages(0), code(0), stack(0), heap(code) {}
 
-void process::allocateMem(uint32_t allocatedSize) {
+void process::allocateMem(uint64_t allocatedSize) {
     heapPages++;
     heap += allocatedSize;
     size += allocatedSize;
 }
 
-void process::freeMem(uint32_t freedSize) {
+void process::freeMem(uint64_t freedSize) {
     heapPages--;
     heap -= freedSize;
     size -= freedSize;
 }
 
-uint32_t process::getHeap() {
+uint64_t process::getHeap() {
     return heap;
 }
 
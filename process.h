@@ -1,23 +1,60 @@
 #ifndef PROCESS_H
 #define PROCESS_H
 
-#include "TwoLevelPageTable.h"
+#include "PageTable.h"
 #include <cstdint>
+#include <bitset>
+#include <set>
+#include <unordered_map>
+#include <deque>
+#include <utility>
+#include <memory>
+#include <map>
+
+// position of a reclaim clock hand: a process (index in the os) and an address in it
+struct ReclaimHand {
+    size_t proc = 0;
+    uint64_t address = 0;
+};
+
+// clock of one reclaim scope, the whole system or one process
+struct ReclaimClock {
+    ReclaimHand front;
+    deque<pair<size_t, uint64_t>> trail;   // pages the front hand passed and the back hand has not
+                                           // (process, first vpn), oldest first: two-handed clock
+};
 
 class process {
 public:
     long int pid;
     long int size;
     long int heapPages;
-    uint32_t code;
-    uint32_t stack;
-    uint32_t heap;
-    TwoLevelPageTable pageTable;
-    process(long int pidGiven);
-    map<uint32_t, map<uint32_t, uint32_t>> hugePageSegmentAccessMap;
-    void allocateMem(uint32_t allocatedSize);
-    void freeMem(uint32_t freedSize);
-    uint32_t getHeap();
+    uint64_t code;
+    uint64_t stack;
+    uint64_t heap;
+    unique_ptr<PageTable> pageTable;
+    // table for an address space of addressBits, see makePageTable()
+    process(long int pidGiven, int addressBits = 32);
+    map<uint32_t, map<uint32_t, uint32_t>> hugePageSegmentAccessMap;   // huge page pfn -> 4KB subpage -> accesses
+    // transparent huge page state, see os::runKhugepaged()
+    map<uint64_t, bitset<128>> regionAccessMap;   // small-page region (vpn / 128) -> 4KB pages touched
+    map<uint32_t, uint32_t> sparseScans;          // huge page pfn -> consecutive scans it was sparse
+    set<uint64_t> reclaimedPages;                 // 4KB pages whose frame was given back by a split
+    set<uint64_t> demandZeroPages;                // 4KB heap pages allocated beyond what memory could hold,
+                                                  // backed on first touch
+    map<uint64_t, uint32_t> swapSlots;            // first vpn of a swapped out page -> first swap slot
+    // tier migration state, see os::migratePages()
+    unordered_map<uint64_t, uint32_t> pageHeat;   // first vpn of a page -> sampled accesses, halved every pass
+    // reclaim state, see os::swapOutToMeetWatermark()
+    uint64_t virtualTime = 0;                     // accesses made by the process: the WSClock clock
+    unordered_map<uint64_t, uint64_t> lastUse;    // first vpn of a page -> virtualTime its accessed bit was last seen
+    unordered_map<uint64_t, uint8_t> pageAge;     // first vpn of a page -> aging register of the lru policy
+    ReclaimClock reclaimClock;                    // hands of local reclaim
+    uint64_t coreMask = 0;                        // cores that ran the process and may cache its
+                                                  // translations: the targets of its tlb shootdowns
+    void allocateMem(uint64_t allocatedSize);
+    void freeMem(uint64_t freedSize);
+    uint64_t getHeap();
     //map<uint32_t, uint32_t> getHugePageAccessMap();
 };
 
@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include "RadixPageTable.h"
+
+using namespace std;
+
+const uint32_t minPageSize = 4096;
+const int levelBits = 9;            // 512 entries per table
+const uint64_t slotMask = 511;
+
+// slot of vpn in its table of level, 4KB pages one slot of level covers, and the first vpn
+// of the next slot: pages are split into pieces at these boundaries
+static inline uint32_t slotOf(uint64_t vpn, int level) {
+    return (vpn >> (levelBits * level)) & slotMask;
+}
+
+static inline uint64_t slotPages(int level) {
+    return 1ull << (levelBits * level);
+}
+
+static inline uint64_t nextSlot(uint64_t vpn, int level) {
+    return (vpn | (slotPages(level) - 1)) + 1;
+}
+
+// 1. constructor
+//    only the root exists, every other table is allocated on first mapping
+RadixPageTable::RadixPageTable(int pidGiven, int levels)
+    : pid(pidGiven), levels(levels), root(make_unique<RadixDirectory>()) {
+    if (levels < 3 || levels > MAX_LEVELS) {
+        throw invalid_argument("A radix page table has 3 to 5 levels");
+    }
+}
+
+// 2. walks
+const RadixDirectory* RadixPageTable::walkTo(uint64_t vpn, int& level) const {
+    const RadixDirectory* directory = root.get();
+    for (level = levels - 1; level > 1; level--) {
+        const RadixNode* child = directory->children[slotOf(vpn, level)].get();
+        if (!child) {
+            break;      // empty or a leaf
+        }
+        directory = static_cast<const RadixDirectory*>(child);
+    }
+    return directory;
+}
+
+int RadixPageTable::descend(uint64_t vpn, RadixDirectory* path[]) {
+    int level = levels - 1;
+    path[level] = root.get();
+    for (; level > 1; level--) {
+        RadixNode* child = path[level]->children[slotOf(vpn, level)].get();
+        if (!child) {
+            break;
+        }
+        path[level - 1] = static_cast<RadixDirectory*>(child);
+    }
+    return level;
+}
+
+// a leaf covers its whole slot; a span start is valid up to the end of its page
+RadixEntry RadixPageTable::lookup(uint64_t vpn) const {
+    if (vpn >> (levelBits * levels)) {
+        return 0;
+    }
+    int level;
+    const RadixDirectory* directory = walkTo(vpn, level);
+    uint32_t slot = slotOf(vpn, level);
+    RadixEntry leaf = Encoding::load(directory->leaves[slot]);
+    if (leaf) {
+        return leaf + (vpn & (slotPages(level) - 1));
+    }
+    if (level != 1 || !directory->children[slot]) {
+        return 0;
+    }
+    return static_cast<const RadixPTEPage*>(directory->children[slot].get())->covering(vpn);
+}
+
+WalkStatus RadixPageTable::translate(uint64_t vaddr, PTE& pte) const {
+    uint64_t vpn = vaddr >> 12;
+    RadixEntry bits = lookup(vpn);
+    if (!bits) {
+        return WALK_INVALID;
+    }
+    pte = Encoding::unpack(bits, vpn);
+    return pte.present ? WALK_OK : WALK_NOT_PRESENT;
+}
+
+uint32_t RadixPageTable::directoryReads(uint64_t vaddr) const {
+    uint64_t vpn = vaddr >> 12;
+    if (vpn >> (levelBits * levels)) {
+        return 1;       // the root entry is read before the fault
+    }
+    int level;
+    walkTo(vpn, level);
+    return levels - level;
+}
+
+bool RadixPageTable::hasPTEPage(uint64_t vaddr) const {
+    uint64_t vpn = vaddr >> 12;
+    if (vpn >> (levelBits * levels)) {
+        return false;
+    }
+    int level;
+    const RadixDirectory* directory = walkTo(vpn, level);
+    return level == 1 && directory->children[slotOf(vpn, 1)] != nullptr;
+}
+
+// 3. setMapping
+//    pages already mapped in the range are unmapped first; then one entry is written per
+//    piece: a leaf per slot for an aligned page of at least a slot, otherwise a span start
+//    in each PTE page the page touches
+int RadixPageTable::leafLevel(uint64_t vpn, uint64_t numPages) {
+    for (int level = 2; level >= 1; level--) {
+        if (numPages >= slotPages(level) && (vpn & (slotPages(level) - 1)) == 0) {
+            return level;
+        }
+    }
+    return 0;
+}
+
+RadixDirectory* RadixPageTable::directoryFor(uint64_t vpn, int level) {
+    RadixDirectory* directory = root.get();
+    for (int l = levels - 1; l > level; l--) {
+        unique_ptr<RadixNode>& child = directory->children[slotOf(vpn, l)];
+        if (!child) {
+            child = make_unique<RadixDirectory>();
+            directory->used++;
+            directories++;
+        }
+        directory = static_cast<RadixDirectory*>(child.get());
+    }
+    return directory;
+}
+
+void RadixPageTable::setMapping(uint32_t pageSize, uint64_t vpn, uint32_t pfn) {
+    uint64_t numPages = pageSize / minPageSize;
+    uint64_t end = vpn + numPages;
+    if (end > (1ull << (levelBits * levels))) {
+        throw out_of_range("Mapping beyond the " + to_string(addressBits()) + "-bit address space");
+    }
+    int leaf = leafLevel(vpn, numPages);
+    unmapOverlapping(vpn, numPages);
+
+    for (uint64_t v = vpn; v < end; v = nextSlot(v, max(leaf, 1))) {
+        if (leaf) {
+            RadixDirectory* directory = directoryFor(v, leaf);
+            directory->leaves[slotOf(v, leaf)] = Encoding::piece(v, vpn, pfn, pageSize);
+            directory->used++;
+            continue;
+        }
+        RadixDirectory* directory = directoryFor(v, 1);
+        unique_ptr<RadixNode>& child = directory->children[slotOf(v, 1)];
+        if (!child) {
+            child = make_unique<RadixPTEPage>();
+            directory->used++;
+            ptePages++;
+        }
+        RadixPTEPage* ptePage = static_cast<RadixPTEPage*>(child.get());
+        ptePage->addStart(v & slotMask, Encoding::piece(v, vpn, pfn, pageSize));
+        ptePage->live += min(end, nextSlot(v, 1)) - v;
+    }
+}
+
+// 4. unmapping
+void RadixPageTable::unmapOverlapping(uint64_t vpn, uint64_t numPages) {
+    uint64_t end = vpn + numPages;
+    for (uint64_t v = vpn; v < end; v = nextSlot(v, 1)) {
+        // the page covering the start of the piece, then every span starting inside it
+        RadixEntry covering = lookup(v);
+        if (covering) {
+            PTE page = Encoding::unpack(covering, v);
+            unmapPage(page.vpn, page.page_size / minPageSize);
+        }
+        uint32_t lastSlot = (min(end, nextSlot(v, 1)) - 1) & slotMask;
+        while (true) {
+            int level;
+            const RadixDirectory* directory = walkTo(v, level);
+            const RadixNode* child = level == 1 ? directory->children[slotOf(v, 1)].get() : nullptr;
+            PTE page;
+            if (!child || !static_cast<const RadixPTEPage*>(child)->lastStartIn(v, lastSlot, page)) {
+                break;
+            }
+            unmapPage(page.vpn, page.page_size / minPageSize);
+        }
+    }
+}
+
+void RadixPageTable::prune(RadixDirectory* path[], uint64_t vpn, int level) {
+    for (int l = level; l < levels - 1 && path[l]->used == 0; l++) {
+        path[l + 1]->children[slotOf(vpn, l + 1)].reset();
+        path[l + 1]->used--;
+        directories--;
+    }
+}
+
+// clear every piece of the page, dropping the tables that become empty
+void RadixPageTable::unmapPage(uint64_t pageVpn, uint64_t numPages) {
+    uint64_t end = pageVpn + numPages;
+    for (uint64_t v = pageVpn; v < end;) {
+        RadixDirectory* path[MAX_LEVELS];
+        int level = descend(v, path);
+        RadixDirectory* directory = path[level];
+        uint32_t slot = slotOf(v, level);
+        if (directory->leaves[slot]) {
+            directory->leaves[slot] = 0;
+            directory->used--;
+            prune(path, v, level);
+            v = nextSlot(v, level);
+            continue;
+        }
+        if (level == 1 && directory->children[slot]) {
+            RadixPTEPage* ptePage = static_cast<RadixPTEPage*>(directory->children[slot].get());
+            ptePage->removeStart(v & slotMask);
+            ptePage->live -= min(end, nextSlot(v, 1)) - v;
+            if (ptePage->live == 0) {
+                directory->children[slot].reset();
+                directory->used--;
+                ptePages--;
+                prune(path, v, 1);
+            }
+        }
+        v = nextSlot(v, 1);
+    }
+}
+
+// 5. free
+//    remove the page containing vpn
+void RadixPageTable::free(uint64_t vpn) {
+    RadixEntry bits = lookup(vpn);
+    if (!bits) {
+        return;
+    }
+    PTE page = Encoding::unpack(bits, vpn);
+    unmapPage(page.vpn, page.page_size / minPageSize);
+}
+
+// 6. present bit, one entry per piece of the page containing vpn
+void RadixPageTable::updatePresentBit(uint64_t vpn) {
+    RadixEntry bits = lookup(vpn);
+    if (!bits) {
+        return;
+    }
+    PTE page = Encoding::unpack(bits, vpn);
+    uint64_t end = page.vpn + page.page_size / minPageSize;
+    for (uint64_t v = page.vpn; v < end;) {
+        RadixDirectory* path[MAX_LEVELS];
+        int level = descend(v, path);
+        uint32_t slot = slotOf(v, level);
+        if (path[level]->leaves[slot]) {
+            path[level]->leaves[slot] &= ~Encoding::presentBit;
+            v = nextSlot(v, level);
+            continue;
+        }
+        if (level == 1 && path[1]->children[slot]) {
+            static_cast<RadixPTEPage*>(path[1]->children[slot].get())->entries[v & slotMask] &= ~Encoding::presentBit;
+        }
+        v = nextSlot(v, 1);
+    }
+}
+
+// 7. accessed bit, in the page's first piece: a leaf or the span start
+RadixEntry* RadixPageTable::firstPieceEntry(uint64_t vpn) {
+    RadixEntry bits = lookup(vpn);
+    if (!bits) {
+        return nullptr;
+    }
+    uint64_t pageVpn = Encoding::unpack(bits, vpn).vpn;
+    RadixDirectory* path[MAX_LEVELS];
+    int level = descend(pageVpn, path);
+    uint32_t slot = slotOf(pageVpn, level);
+    if (path[level]->leaves[slot]) {
+        return &path[level]->leaves[slot];
+    }
+    return &static_cast<RadixPTEPage*>(path[1]->children[slot].get())->entries[pageVpn & slotMask];
+}
+
+void RadixPageTable::markAccessed(uint64_t vpn) {
+    Encoding::markAccessed(firstPieceEntry(vpn));
+}
+
+bool RadixPageTable::testAndClearAccessed(uint64_t vpn) {
+    return Encoding::testAndClearAccessed(firstPieceEntry(vpn));
+}
+
+// 8. page table memory footprint in bytes
+size_t RadixPageTable::footprintBytes() const {
+    return (1 + directories) * sizeof(RadixDirectory) + ptePages * sizeof(RadixPTEPage);
+}
@@ -0,0 +1,222 @@
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include "Simulation.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+void replayTrace(os& osInstance, TraceReader& trace, bool parallel) {
+    if (parallel) {
+        osInstance.replayOnCores(trace);
+    }
+    while (const TraceRecord* record = trace.next()) {
+        osInstance.handleInstruction(Opcode(record->opcode), record->value, record->pid, record->core);
+    }
+    osInstance.stopKswapd();
+}
+
+SimulationResult runSimulation(const SimulationParams& params) {
+    SimulationResult result;
+    result.params = params;
+    auto start = chrono::steady_clock::now();
+    try {
+        TraceReader trace(params.traceFile.c_str());
+        unique_ptr<os> osInstance(new os(params.memorySize, params.diskSize, params.highWatermark,
+                                         params.lowWatermark, params.cacheChoice,
+                                         params.tlbConfig, params.cacheConfig, params.costModel, params.thpConfig,
+                                         params.tieringConfig, params.swapDirectory,
+                                         params.reclaimConfig, params.cores, params.addressBits));
+        replayTrace(*osInstance, trace, params.parallel);
+        result.stats = osInstance->getStats();
+    } catch (const exception& e) {
+        result.error = e.what();
+    }
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+vector<SimulationResult> runSweep(const vector<SimulationParams>& runs, size_t numThreads) {
+    vector<SimulationResult> results(runs.size());
+    if (numThreads == 0) {
+        numThreads = thread::hardware_concurrency();
+    }
+    ThreadPool pool(min(max<size_t>(numThreads, 1), max<size_t>(runs.size(), 1)));
+    for (size_t i = 0; i < runs.size(); i++) {
+        pool.submit([&results, &runs, i] { results[i] = runSimulation(runs[i]); });
+    }
+    pool.wait();
+    return results;
+}
+
+static const char* tlbReplacementName(TlbReplacement policy) {
+    switch (policy) {
+    case TLB_REPLACE_RANDOM: return "random";
+    case TLB_REPLACE_FIFO: return "fifo";
+    case TLB_REPLACE_LRU: return "lru";
+    case TLB_REPLACE_CLOCK: return "clock";
+    case TLB_REPLACE_SRRIP: return "srrip";
+    }
+    return "unknown";
+}
+
+static const char* tlbPrefetchName(TlbPrefetchKind kind) {
+    switch (kind) {
+    case TLB_PREFETCH_NONE: return "none";
+    case TLB_PREFETCH_SEQUENTIAL: return "sequential";
+    case TLB_PREFETCH_STRIDE: return "stride";
+    case TLB_PREFETCH_DISTANCE: return "distance";
+    }
+    return "unknown";
+}
+
+static const char* placementName(PlacementPolicy policy) {
+    switch (policy) {
+    case PLACE_FAST_FIRST: return "fast";
+    case PLACE_SLOW_FIRST: return "slow";
+    case PLACE_INTERLEAVE: return "interleave";
+    }
+    return "unknown";
+}
+
+static const char* reclaimPolicyName(ReclaimPolicy policy) {
+    switch (policy) {
+    case RECLAIM_ADDRESS: return "address";
+    case RECLAIM_CLOCK: return "clock";
+    case RECLAIM_CLOCK2: return "clock2";
+    case RECLAIM_WSCLOCK: return "wsclock";
+    case RECLAIM_LRU: return "lru";
+    }
+    return "unknown";
+}
+
+static const char* cachePolicyName(CachePolicy policy) {
+    switch (policy) {
+    case CACHE_LFU: return "lfu";
+    case CACHE_LRU: return "lru";
+    case CACHE_ARC: return "arc";
+    }
+    return "unknown";
+}
+
+// trace paths and error messages are free text: a JSON string literal, an RFC 4180 field
+static string jsonString(const string& text) {
+    string quoted = "\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (c < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            quoted += escape;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + '"';
+}
+
+static string csvField(const string& text) {
+    if (text.find_first_of(",\"\r\n") == string::npos) {
+        return text;
+    }
+    string quoted = "\"";
+    for (char c : text) {
+        if (c == '"') {
+            quoted += '"';
+        }
+        quoted += c;
+    }
+    return quoted + '"';
+}
+
+void writeSweepCsv(ostream& out, const vector<SimulationResult>& results) {
+    out << "trace,cache_choice,l1_size,l2_size,l1_ways,l2_ways,tlb_hash,l1_policy,l2_policy,asid_bits,"
+        << "l2_partition,pde_cache,pde_cache_ways,prefetch,prefetch_degree,prefetch_buffer,thp,thp_promote,thp_demote,"
+        << "placement,migrate_interval,memory_mb,address_bits,kswapd,reclaim_policy,reclaim_scope,cores,parallel,cache_policy,cache_size,"
+        << "accesses,l1_hit,l2_hit,tlb_miss,walk_refs,stack_miss,heap_miss,code_miss,"
+        << "page_walks,pde_cache_hits,walk_refs_per_access,page_faults,swap_outs,swap_ins,direct_reclaims,kswapd_pages,invalid_accesses,cache_hit,cache_miss,context_switches,l1_flushes,"
+        << "cycles,amat,thp_promotions,thp_demotions,thp_reclaimed_pages,thp_refaults,prefetch_issued,prefetch_useful,prefetch_accuracy,prefetch_coverage,"
+        << "fast_tier_fraction,tier_promotions,tier_demotions,migration_bytes,tlb_shootdowns,shootdown_ipis,seconds,error" << endl;
+    for (const SimulationResult& r : results) {
+        const SimulationParams& p = r.params;
+        const SimStats& s = r.stats;
+        out << csvField(p.traceFile) << ',' << p.cacheChoice << ','
+            << p.tlbConfig.l1_size << ',' << p.tlbConfig.l2_size << ','
+            << p.tlbConfig.l1_ways << ',' << p.tlbConfig.l2_ways << ','
+            << (p.tlbConfig.index_hash == TLB_HASH_XOR ? "xor" : "mod") << ','
+            << tlbReplacementName(p.tlbConfig.l1_policy) << ',' << tlbReplacementName(p.tlbConfig.l2_policy) << ','
+            << p.tlbConfig.asid_bits << ','
+            << (p.tlbConfig.l2_partitioning == TLB_L2_UCP ? "ucp" : "static") << ','
+            << p.tlbConfig.pde_cache_size << ',' << p.tlbConfig.pde_cache_ways << ','
+            << tlbPrefetchName(p.tlbConfig.prefetcher) << ',' << p.tlbConfig.prefetch_degree << ','
+            << p.tlbConfig.prefetch_buffer << ','
+            << (p.thpConfig.enabled ? "on" : "off") << ',' << p.thpConfig.promoteThreshold << ','
+            << p.thpConfig.demoteThreshold << ','
+            << placementName(p.tieringConfig.placement) << ',' << p.tieringConfig.migrateInterval << ','
+            << (p.memorySize >> 20) << ',' << p.addressBits << ','
+            << (p.reclaimConfig.kswapd ? "on" : "off") << ','
+            << reclaimPolicyName(p.reclaimConfig.policy) << ',' << (p.reclaimConfig.local ? "local" : "global") << ','
+            << p.cores << ',' << (p.parallel ? "on" : "off") << ','
+            << cachePolicyName(p.cacheConfig.policy) << ',' << p.cacheConfig.capacity << ','
+            << s.memory_access_attempts << ',' << s.L1_hit << ',' << s.L2_hit << ','
+            << s.TLB_miss << ',' << s.memory_hit << ',' << s.segmentMisses(SEG_STACK) << ','
+            << s.segmentMisses(SEG_HEAP) << ',' << s.segmentMisses(SEG_CODE) << ','
+            << s.page_walks << ',' << s.pde_cache_hits << ',' << s.walkRefsPerAccess() << ',' << s.page_faults << ','
+            << s.swap_outs << ',' << s.swap_ins << ',' << s.direct_reclaims << ',' << s.kswapd_pages << ','
+            << s.invalid_accesses << ',' << s.cache_hit << ',' << s.cache_miss << ','
+            << s.context_switches << ',' << s.l1_flushes << ','
+            << s.totalCycles() << ',' << s.amat() << ','
+            << s.thp_promotions << ',' << s.thp_demotions << ',' << s.thp_reclaimed_pages << ','
+            << s.thp_refaults << ','
+            << s.prefetch_issued << ',' << s.prefetch_useful << ','
+            << s.prefetchAccuracy() << ',' << s.prefetchCoverage() << ','
+            << s.fastTierFraction() << ',' << s.migration_promotions << ',' << s.migration_demotions << ','
+            << s.migration_bytes << ',' << s.tlb_shootdowns << ',' << s.shootdown_ipis << ','
+            << r.seconds << ',' << csvField(r.error) << endl;
+    }
+}
+
+void writeSweepJson(ostream& out, const vector<SimulationResult>& results) {
+    out << "[";
+    for (size_t i = 0; i < results.size(); i++) {
+        const SimulationResult& r = results[i];
+        const SimulationParams& p = r.params;
+        out << (i ? "," : "") << "\n{\"trace\": " << jsonString(p.traceFile)
+            << ", \"cache_choice\": " << p.cacheChoice
+            << ", \"l1_size\": " << p.tlbConfig.l1_size << ", \"l2_size\": " << p.tlbConfig.l2_size
+            << ", \"l1_ways\": " << p.tlbConfig.l1_ways << ", \"l2_ways\": " << p.tlbConfig.l2_ways
+            << ", \"tlb_hash\": \"" << (p.tlbConfig.index_hash == TLB_HASH_XOR ? "xor" : "mod") << "\""
+            << ", \"l1_policy\": \"" << tlbReplacementName(p.tlbConfig.l1_policy) << "\""
+            << ", \"l2_policy\": \"" << tlbReplacementName(p.tlbConfig.l2_policy) << "\""
+            << ", \"asid_bits\": " << p.tlbConfig.asid_bits
+            << ", \"l2_partition\": \"" << (p.tlbConfig.l2_partitioning == TLB_L2_UCP ? "ucp" : "static") << "\""
+            << ", \"pde_cache\": " << p.tlbConfig.pde_cache_size
+            << ", \"pde_cache_ways\": " << p.tlbConfig.pde_cache_ways
+            << ", \"prefetch\": \"" << tlbPrefetchName(p.tlbConfig.prefetcher) << "\""
+            << ", \"prefetch_degree\": " << p.tlbConfig.prefetch_degree
+            << ", \"prefetch_buffer\": " << p.tlbConfig.prefetch_buffer
+            << ", \"thp\": " << (p.thpConfig.enabled ? "true" : "false")
+            << ", \"thp_promote\": " << p.thpConfig.promoteThreshold
+            << ", \"thp_demote\": " << p.thpConfig.demoteThreshold
+            << ", \"placement\": \"" << placementName(p.tieringConfig.placement) << "\""
+            << ", \"migrate_interval\": " << p.tieringConfig.migrateInterval
+            << ", \"memory_mb\": " << (p.memorySize >> 20)
+            << ", \"address_bits\": " << p.addressBits
+            << ", \"kswapd\": " << (p.reclaimConfig.kswapd ? "true" : "false")
+            << ", \"reclaim_policy\": \"" << reclaimPolicyName(p.reclaimConfig.policy) << "\""
+            << ", \"reclaim_scope\": \"" << (p.reclaimConfig.local ? "local" : "global") << "\""
+            << ", \"cores\": " << p.cores
+            << ", \"parallel\": " << (p.parallel ? "true" : "false")
+            << ", \"cache_policy\": \"" << cachePolicyName(p.cacheConfig.policy) << "\""
+            << ", \"cache_size\": " << p.cacheConfig.capacity
+            << ", \"seconds\": " << r.seconds
+            << ", \"error\": " << jsonString(r.error)
+            << ",\n\"stats\": ";
+        r.stats.writeJson(out);
+        out << "}";
+    }
+    out << "\n]" << endl;
+}
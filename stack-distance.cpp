@@ -0,0 +1,89 @@
+#include <string>
+#include "StackDistance.h"
+
+using namespace std;
+
+// 1. fenwick tree
+void FenwickTree::add(size_t pos, int32_t delta) {
+    for (; pos < tree.size(); pos += pos & (0 - pos)) {
+        tree[pos] += delta;
+    }
+}
+
+int64_t FenwickTree::prefix(size_t pos) const {
+    int64_t sum = 0;
+    for (; pos > 0; pos -= pos & (0 - pos)) {
+        sum += tree[pos];
+    }
+    return sum;
+}
+
+// 2. histogram
+void ReuseHistogram::addDistance(size_t distance) {
+    if (distance >= counts.size()) {
+        counts.resize(distance + 1, 0);
+    }
+    counts[distance]++;
+    total++;
+}
+
+void ReuseHistogram::addCold() {
+    cold++;
+    total++;
+}
+
+void ReuseHistogram::decay() {
+    total = 0;
+    for (uint64_t& count : counts) {
+        count /= 2;
+        total += count;
+    }
+    cold /= 2;
+    total += cold;
+}
+
+uint64_t ReuseHistogram::hits(size_t capacity) const {
+    uint64_t sum = 0;
+    for (size_t d = 0; d < capacity && d < counts.size(); d++) {
+        sum += counts[d];
+    }
+    return sum;
+}
+
+double ReuseHistogram::hitRate(size_t capacity) const {
+    return total ? double(hits(capacity)) / total : 0;
+}
+
+// 3. curves
+void writeHitRateCurves(ostream& out, const vector<pair<string, const ReuseHistogram*>>& curves,
+                        vector<size_t> extraCapacities) {
+    size_t largest = 1;
+    for (const auto& curve : curves) {
+        largest = max(largest, curve.second->maxUsefulCapacity());
+    }
+    vector<size_t> capacities = extraCapacities;
+    for (size_t capacity = 1; ; capacity *= 2) {
+        capacities.push_back(capacity);
+        if (capacity >= largest) {
+            break;
+        }
+    }
+    sort(capacities.begin(), capacities.end());
+    capacities.erase(unique(capacities.begin(), capacities.end()), capacities.end());
+
+    out << "capacity";
+    for (const auto& curve : curves) {
+        out << ',' << curve.first;
+    }
+    out << endl;
+    for (size_t capacity : capacities) {
+        if (capacity == 0) {
+            continue;
+        }
+        out << capacity;
+        for (const auto& curve : curves) {
+            out << ',' << curve.second->hitRate(capacity);
+        }
+        out << endl;
+    }
+}
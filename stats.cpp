@@ -0,0 +1,356 @@
+#include <string>
+#include "Stats.h"
+
+using namespace std;
+
+static const char* const segmentNames[SEG_COUNT] = {"code", "stack", "heap"};
+static const char* const costNames[COST_COUNT] = {
+    "l1_tlb", "l2_tlb", "walk_pde", "walk_pte", "data", "page_fault", "swap", "migration", "shootdown"
+};
+
+const char* segmentName(Segment segment) {
+    return segment < SEG_COUNT ? segmentNames[segment] : "unknown";
+}
+
+const char* costComponentName(CostComponent component) {
+    return component < COST_COUNT ? costNames[component] : "unknown";
+}
+
+bool CostModel::set(const string& name, uint32_t value) {
+    const pair<const char*, uint32_t*> fields[] = {
+        {"l1_tlb", &l1_tlb}, {"l2_tlb", &l2_tlb}, {"walk_pde", &walk_pde}, {"walk_pte", &walk_pte},
+        {"cache_hit", &cache_hit}, {"cache_miss", &cache_miss}, {"page_fault", &page_fault},
+        {"swap_read", &swap_read}, {"swap_write", &swap_write}, {"shootdown", &shootdown}, {"ipi", &ipi}
+    };
+    for (const auto& field : fields) {
+        if (name == field.first) {
+            *field.second = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+AccessCounters& AccessCounters::operator+=(const AccessCounters& other) {
+    accesses += other.accesses;
+    l1_hit += other.l1_hit;
+    l2_hit += other.l2_hit;
+    tlb_miss += other.tlb_miss;
+    walk_refs += other.walk_refs;
+    page_faults += other.page_faults;
+    invalid_accesses += other.invalid_accesses;
+    cache_hit += other.cache_hit;
+    cache_miss += other.cache_miss;
+    for (int c = 0; c < COST_COUNT; c++) {
+        cycles[c] += other.cycles[c];
+    }
+    return *this;
+}
+
+uint64_t AccessCounters::totalCycles() const {
+    uint64_t total = 0;
+    for (int c = 0; c < COST_COUNT; c++) {
+        total += cycles[c];
+    }
+    return total;
+}
+
+double AccessCounters::amat() const {
+    return accesses ? double(totalCycles()) / accesses : 0;
+}
+
+// 1. record
+void SimStats::record(const AccessRecord& access) {
+    AccessCounters one;
+    one.accesses = 1;
+    one.l1_hit = access.level == STATS_L1;
+    one.l2_hit = access.level == STATS_L2;
+    one.tlb_miss = access.level == STATS_MISS;
+    one.walk_refs = access.walkRefs;
+    one.page_faults = access.pageFault;
+    one.invalid_accesses = access.invalid;
+    one.cache_hit = access.cacheResult == 1;
+    one.cache_miss = access.cacheResult == 0;
+    for (int c = 0; c < COST_COUNT; c++) {
+        one.cycles[c] = access.cycles[c];
+        cycles[c] += access.cycles[c];
+    }
+
+    segments[access.segment] += one;
+    processes[access.pid] += one;
+    cores[access.core] += one;
+    if (access.pageSize) {
+        pageSizes[access.pageSize] += one;
+    }
+}
+
+void SimStats::charge(uint32_t pid, uint32_t core, CostComponent component, uint64_t amount) {
+    processes[pid].cycles[component] += amount;
+    cores[core].cycles[component] += amount;
+    cycles[component] += amount;
+}
+
+SimStats& SimStats::operator+=(const SimStats& other) {
+    uint64_t SimStats::* const totals[] = {
+        &SimStats::L1_hit, &SimStats::L2_hit, &SimStats::TLB_miss, &SimStats::memory_hit,
+        &SimStats::memory_access_attempts, &SimStats::page_faults, &SimStats::invalid_accesses,
+        &SimStats::cache_hit, &SimStats::cache_miss, &SimStats::context_switches,
+        &SimStats::l1_flushes, &SimStats::page_walks, &SimStats::pde_cache_hits,
+        &SimStats::walk_pde_refs, &SimStats::walk_pte_refs, &SimStats::prefetch_issued,
+        &SimStats::prefetch_useful, &SimStats::prefetch_walks, &SimStats::swap_outs,
+        &SimStats::swap_ins, &SimStats::direct_reclaims, &SimStats::direct_reclaim_pages,
+        &SimStats::kswapd_wakeups, &SimStats::kswapd_pages, &SimStats::reclaim_scanned,
+        &SimStats::reclaim_referenced, &SimStats::thp_scans, &SimStats::thp_promotions,
+        &SimStats::thp_promote_failed, &SimStats::thp_copied_pages, &SimStats::thp_demotions,
+        &SimStats::thp_reclaimed_pages, &SimStats::thp_refaults, &SimStats::migration_passes,
+        &SimStats::migration_promotions, &SimStats::migration_demotions, &SimStats::migration_bytes,
+        &SimStats::tlb_shootdowns, &SimStats::shootdown_ipis, &SimStats::shootdown_invalidations
+    };
+    for (uint64_t SimStats::* total : totals) {
+        this->*total += other.*total;
+    }
+    for (int c = 0; c < COST_COUNT; c++) {
+        cycles[c] += other.cycles[c];
+    }
+    for (int s = 0; s < SEG_COUNT; s++) {
+        segments[s] += other.segments[s];
+    }
+    for (const auto& entry : other.processes) {
+        processes[entry.first] += entry.second;
+    }
+    for (const auto& entry : other.cores) {
+        cores[entry.first] += entry.second;
+    }
+    for (const auto& entry : other.pageSizes) {
+        pageSizes[entry.first] += entry.second;
+    }
+    l2Shares.insert(l2Shares.end(), other.l2Shares.begin(), other.l2Shares.end());
+    for (size_t t = 0; t < tiers.size() && t < other.tiers.size(); t++) {
+        tiers[t].accesses += other.tiers[t].accesses;
+        tiers[t].promoted_in += other.tiers[t].promoted_in;
+        tiers[t].demoted_in += other.tiers[t].demoted_in;
+        tiers[t].migrated_bytes += other.tiers[t].migrated_bytes;
+    }
+    return *this;
+}
+
+uint64_t SimStats::totalCycles() const {
+    uint64_t total = 0;
+    for (int c = 0; c < COST_COUNT; c++) {
+        total += cycles[c];
+    }
+    return total;
+}
+
+double SimStats::amat() const {
+    return memory_access_attempts ? double(totalCycles()) / memory_access_attempts : 0;
+}
+
+double SimStats::prefetchAccuracy() const {
+    return prefetch_issued ? double(prefetch_useful) / prefetch_issued : 0;
+}
+
+double SimStats::prefetchCoverage() const {
+    return prefetch_useful + TLB_miss ? double(prefetch_useful) / (prefetch_useful + TLB_miss) : 0;
+}
+
+double SimStats::walkRefsPerWalk() const {
+    return page_walks ? double(memory_hit) / page_walks : 0;
+}
+
+double SimStats::walkRefsPerAccess() const {
+    return memory_access_attempts ? double(memory_hit) / memory_access_attempts : 0;
+}
+
+double SimStats::fastTierFraction() const {
+    uint64_t accesses = 0;
+    for (const TierCounters& tier : tiers) {
+        accesses += tier.accesses;
+    }
+    return accesses ? double(tiers[0].accesses) / accesses : 0;
+}
+
+// 2. exporters
+static AccessCounters totals(const SimStats& stats) {
+    AccessCounters total;
+    total.accesses = stats.memory_access_attempts;
+    total.l1_hit = stats.L1_hit;
+    total.l2_hit = stats.L2_hit;
+    total.tlb_miss = stats.TLB_miss;
+    total.walk_refs = stats.memory_hit;
+    total.page_faults = stats.page_faults;
+    total.invalid_accesses = stats.invalid_accesses;
+    total.cache_hit = stats.cache_hit;
+    total.cache_miss = stats.cache_miss;
+    for (int c = 0; c < COST_COUNT; c++) {
+        total.cycles[c] = stats.cycles[c];
+    }
+    return total;
+}
+
+static void writeJsonCounters(ostream& out, const AccessCounters& c) {
+    out << "{\"accesses\": " << c.accesses
+        << ", \"l1_hit\": " << c.l1_hit
+        << ", \"l2_hit\": " << c.l2_hit
+        << ", \"tlb_miss\": " << c.tlb_miss
+        << ", \"walk_refs\": " << c.walk_refs
+        << ", \"page_faults\": " << c.page_faults
+        << ", \"invalid_accesses\": " << c.invalid_accesses
+        << ", \"cache_hit\": " << c.cache_hit
+        << ", \"cache_miss\": " << c.cache_miss
+        << ", \"cycles\": " << c.totalCycles() << ", \"amat\": " << c.amat() << "}";
+}
+
+static void writeJsonMap(ostream& out, const map<uint32_t, AccessCounters>& buckets) {
+    out << "{";
+    const char* separator = "";
+    for (const auto& bucket : buckets) {
+        out << separator << "\n    \"" << bucket.first << "\": ";
+        writeJsonCounters(out, bucket.second);
+        separator = ",";
+    }
+    out << (buckets.empty() ? "}" : "\n  }");
+}
+
+void SimStats::writeJson(ostream& out) const {
+    out << "{\n  \"total\": ";
+    writeJsonCounters(out, totals(*this));
+    out << ",\n  \"events\": {\"context_switches\": " << context_switches
+        << ", \"l1_flushes\": " << l1_flushes << "}";
+    out << ",\n  \"prefetch\": {\"issued\": " << prefetch_issued << ", \"useful\": " << prefetch_useful
+        << ", \"walks\": " << prefetch_walks << ", \"accuracy\": " << prefetchAccuracy()
+        << ", \"coverage\": " << prefetchCoverage() << "}";
+    out << ",\n  \"walks\": {\"walks\": " << page_walks << ", \"pde_cache_hits\": " << pde_cache_hits
+        << ", \"pde_refs\": " << walk_pde_refs << ", \"pte_refs\": " << walk_pte_refs
+        << ", \"refs_per_walk\": " << walkRefsPerWalk() << ", \"refs_per_access\": " << walkRefsPerAccess() << "}";
+    out << ",\n  \"cycles\": {\"total\": " << totalCycles() << ", \"amat\": " << amat();
+    for (int c = 0; c < COST_COUNT; c++) {
+        out << ", \"" << costNames[c] << "\": " << cycles[c];
+    }
+    out << ", \"swap_outs\": " << swap_outs << ", \"swap_ins\": " << swap_ins << "}";
+    out << ",\n  \"reclaim\": {\"direct_reclaims\": " << direct_reclaims
+        << ", \"direct_reclaim_pages\": " << direct_reclaim_pages << ", \"kswapd_wakeups\": " << kswapd_wakeups
+        << ", \"kswapd_pages\": " << kswapd_pages << ", \"scanned\": " << reclaim_scanned
+        << ", \"referenced\": " << reclaim_referenced << "}";
+    out << ",\n  \"thp\": {\"scans\": " << thp_scans << ", \"promotions\": " << thp_promotions
+        << ", \"promote_failed\": " << thp_promote_failed << ", \"copied_pages\": " << thp_copied_pages
+        << ", \"demotions\": " << thp_demotions << ", \"reclaimed_pages\": " << thp_reclaimed_pages
+        << ", \"refaults\": " << thp_refaults << "}";
+    out << ",\n  \"tiers\": {\"fast_tier_fraction\": " << fastTierFraction()
+        << ", \"migration_passes\": " << migration_passes << ", \"promotions\": " << migration_promotions
+        << ", \"demotions\": " << migration_demotions << ", \"migration_bytes\": " << migration_bytes
+        << ", \"tiers\": [";
+    for (size_t i = 0; i < tiers.size(); i++) {
+        const TierCounters& t = tiers[i];
+        out << (i ? ", " : "") << "{\"name\": \"" << t.name << "\", \"accesses\": " << t.accesses
+            << ", \"promoted_in\": " << t.promoted_in << ", \"demoted_in\": " << t.demoted_in
+            << ", \"migrated_bytes\": " << t.migrated_bytes << "}";
+    }
+    out << "]}";
+    out << ",\n  \"shootdowns\": {\"rounds\": " << tlb_shootdowns << ", \"ipis\": " << shootdown_ipis
+        << ", \"invalidations\": " << shootdown_invalidations << "}";
+    out << ",\n  \"segments\": {";
+    for (int s = 0; s < SEG_COUNT; s++) {
+        out << (s ? "," : "") << "\n    \"" << segmentNames[s] << "\": ";
+        writeJsonCounters(out, segments[s]);
+    }
+    out << "\n  },\n  \"processes\": ";
+    writeJsonMap(out, processes);
+    out << ",\n  \"cores\": ";
+    writeJsonMap(out, cores);
+    out << ",\n  \"page_sizes\": ";
+    writeJsonMap(out, pageSizes);
+    out << ",\n  \"l2_shares\": [";
+    for (size_t i = 0; i < l2Shares.size(); i++) {
+        const L2ShareSample& s = l2Shares[i];
+        out << (i ? "," : "") << "\n    {\"time\": " << s.time << ", \"pid\": " << s.pid
+            << ", \"quota\": " << s.quota << ", \"occupancy\": " << s.occupancy
+            << ", \"capacity\": " << s.capacity
+            << ", \"lookups\": " << s.lookups << ", \"hits\": " << s.hits << "}";
+    }
+    out << (l2Shares.empty() ? "]" : "\n  ]") << "\n}" << endl;
+}
+
+void SimStats::writeL2SharesCsv(ostream& out) const {
+    out << "time,pid,quota,occupancy,share,lookups,hits,hit_rate" << endl;
+    for (const L2ShareSample& s : l2Shares) {
+        out << s.time << ',' << s.pid << ',' << s.quota << ',' << s.occupancy << ','
+            << (s.capacity ? double(s.occupancy) / s.capacity : 0) << ',' << s.lookups << ',' << s.hits << ',' << (s.lookups ? double(s.hits) / s.lookups : 0) << endl;
+    }
+}
+
+static void writeCsvRow(ostream& out, const char* scope, const string& key, const AccessCounters& c) {
+    out << scope << ',' << key << ',' << c.accesses << ',' << c.l1_hit << ',' << c.l2_hit << ','
+        << c.tlb_miss << ',' << c.walk_refs << ',' << c.page_faults << ',' << c.invalid_accesses << ','
+        << c.cache_hit << ',' << c.cache_miss;
+    for (int k = 0; k < COST_COUNT; k++) {
+        out << ',' << c.cycles[k];
+    }
+    out << ',' << c.totalCycles() << ',' << c.amat() << endl;
+}
+
+void SimStats::writeCsv(ostream& out) const {
+    out << "scope,key,accesses,l1_hit,l2_hit,tlb_miss,walk_refs,page_faults,invalid_accesses,"
+        << "cache_hit,cache_miss";
+    for (int c = 0; c < COST_COUNT; c++) {
+        out << ",cycles_" << costNames[c];
+    }
+    out << ",cycles,amat" << endl;
+    writeCsvRow(out, "total", "", totals(*this));
+    AccessCounters event;
+    event.accesses = context_switches;
+    writeCsvRow(out, "event", "context_switches", event);
+    event.accesses = l1_flushes;
+    writeCsvRow(out, "event", "l1_flushes", event);
+    event.accesses = prefetch_issued;
+    writeCsvRow(out, "event", "prefetch_issued", event);
+    event.accesses = prefetch_useful;
+    writeCsvRow(out, "event", "prefetch_useful", event);
+    event.accesses = prefetch_walks;
+    writeCsvRow(out, "event", "prefetch_walks", event);
+    event.accesses = page_walks;
+    writeCsvRow(out, "event", "page_walks", event);
+    event.accesses = pde_cache_hits;
+    writeCsvRow(out, "event", "pde_cache_hits", event);
+    event.accesses = walk_pde_refs;
+    writeCsvRow(out, "event", "walk_pde_refs", event);
+    event.accesses = walk_pte_refs;
+    writeCsvRow(out, "event", "walk_pte_refs", event);
+    event.accesses = swap_outs;
+    writeCsvRow(out, "event", "swap_outs", event);
+    event.accesses = swap_ins;
+    writeCsvRow(out, "event", "swap_ins", event);
+    const pair<const char*, uint64_t> daemonEvents[] = {
+        {"direct_reclaims", direct_reclaims}, {"direct_reclaim_pages", direct_reclaim_pages},
+        {"kswapd_wakeups", kswapd_wakeups}, {"kswapd_pages", kswapd_pages},
+        {"reclaim_scanned", reclaim_scanned}, {"reclaim_referenced", reclaim_referenced},
+        {"thp_scans", thp_scans}, {"thp_promotions", thp_promotions},
+        {"thp_promote_failed", thp_promote_failed}, {"thp_copied_pages", thp_copied_pages},
+        {"thp_demotions", thp_demotions}, {"thp_reclaimed_pages", thp_reclaimed_pages},
+        {"thp_refaults", thp_refaults}, {"migration_passes", migration_passes},
+        {"migration_promotions", migration_promotions}, {"migration_demotions", migration_demotions},
+        {"migration_bytes", migration_bytes}, {"tlb_shootdowns", tlb_shootdowns},
+        {"shootdown_ipis", shootdown_ipis}, {"shootdown_invalidations", shootdown_invalidations}
+    };
+    for (const auto& daemonEvent : daemonEvents) {
+        event.accesses = daemonEvent.second;
+        writeCsvRow(out, "event", daemonEvent.first, event);
+    }
+    for (const TierCounters& tier : tiers) {
+        AccessCounters served;
+        served.accesses = tier.accesses;
+        writeCsvRow(out, "tier", tier.name, served);
+    }
+    for (int s = 0; s < SEG_COUNT; s++) {
+        writeCsvRow(out, "segment", segmentNames[s], segments[s]);
+    }
+    for (const auto& bucket : processes) {
+        writeCsvRow(out, "process", to_string(bucket.first), bucket.second);
+    }
+    for (const auto& bucket : cores) {
+        writeCsvRow(out, "core", to_string(bucket.first), bucket.second);
+    }
+    for (const auto& bucket : pageSizes) {
+        writeCsvRow(out, "page_size", to_string(bucket.first), bucket.second);
+    }
+}
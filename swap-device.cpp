@@ -0,0 +1,123 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include "SwapDevice.h"
+
+using namespace std;
+
+// 1. constructor, the file itself is opened on the first write
+SwapDevice::SwapDevice(size_t size, const string& directory)
+    : directory(directory), slots(size / SWAP_SLOT_SIZE), freeCount(size / SWAP_SLOT_SIZE),
+      bitmap((size / SWAP_SLOT_SIZE + 63) / 64, 0) {
+    if (this->directory.empty()) {
+        const char* tmp = getenv("TMPDIR");
+        this->directory = tmp && *tmp ? tmp : "/tmp";
+    }
+}
+
+SwapDevice::~SwapDevice() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+void SwapDevice::open() {
+    string path = directory + "/vmsim-swap-XXXXXX";
+    vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    fd = mkstemp(name.data());
+    if (fd < 0) {
+        throw runtime_error("Unable to create swap file in " + directory + ": " + strerror(errno));
+    }
+    unlink(name.data());
+}
+
+// 2. slot allocation: next fit over the bitmap, skipping full words
+void SwapDevice::mark(uint32_t slot, uint32_t count, bool used) {
+    for (uint32_t s = slot; s < slot + count; s++) {
+        if (used) {
+            bitmap[s / 64] |= 1ull << (s % 64);
+        } else {
+            bitmap[s / 64] &= ~(1ull << (s % 64));
+        }
+    }
+    freeCount = used ? freeCount - count : freeCount + count;
+}
+
+uint32_t SwapDevice::allocate(uint32_t count) {
+    if (count == 0 || count > freeCount) {
+        return NO_SLOT;
+    }
+    // two rounds: from the cursor to the end, then from the start
+    for (int round = 0; round < 2; round++) {
+        size_t slot = round ? 0 : hint;
+        size_t end = round ? min(hint + count, slots) : slots;
+        size_t run = 0;
+        while (slot < end) {
+            if (run == 0 && slot % 64 == 0 && bitmap[slot / 64] == ~0ull) {
+                slot += 64;
+                continue;
+            }
+            run = used(slot) ? 0 : run + 1;
+            slot++;
+            if (run == count) {
+                uint32_t first = slot - count;
+                mark(first, count, true);
+                hint = slot == slots ? 0 : slot;
+                return first;
+            }
+        }
+    }
+    return NO_SLOT;
+}
+
+void SwapDevice::free(uint32_t slot, uint32_t count) {
+    if (slot + count > slots) {
+        throw logic_error("Freeing swap slots outside the device");
+    }
+    mark(slot, count, false);
+}
+
+// 3. page I/O
+void SwapDevice::write(uint32_t slot, const void* data, size_t bytes) {
+    if (fd < 0) {
+        open();
+    }
+    const char* buffer = static_cast<const char*>(data);
+    off_t offset = off_t(slot) * SWAP_SLOT_SIZE;
+    while (bytes > 0) {
+        ssize_t written = pwrite(fd, buffer, bytes, offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            throw runtime_error(string("Swap write failed: ") + strerror(errno));
+        }
+        buffer += written;
+        offset += written;
+        bytes -= written;
+    }
+}
+
+void SwapDevice::read(uint32_t slot, void* data, size_t bytes) {
+    if (fd < 0) {
+        throw logic_error("Reading a swap slot that was never written");
+    }
+    char* buffer = static_cast<char*>(data);
+    off_t offset = off_t(slot) * SWAP_SLOT_SIZE;
+    while (bytes > 0) {
+        ssize_t got = pread(fd, buffer, bytes, offset);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            throw runtime_error(string("Swap read failed: ") + (got ? strerror(errno) : "short read"));
+        }
+        buffer += got;
+        offset += got;
+        bytes -= got;
+    }
+}
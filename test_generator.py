@@ -5,9 +5,11 @@ from io import TextIOWrapper
 import numpy as np
 import argparse
 '''
-Usage: python test_generator.py <num_tests> <process list>
+Usage: python test_generator.py [--address-bits=32|48|57] <num_tests> <process list>
 E.g.: python3 test_generator.py 10000 0.5:1024 0.6:102400 0.95:`expr 1024 \\* 1024 \\* 1024`
 For each process, two parameters are needed to be specified: locality and max memory
+With 48 or 57 address bits the stack sits at the top of the wider address space, and
+allocations may also be 1 GB pages (run the simulator with the same --address-bits).
 
 For each process, it could be
 1. matrix multiplication application, sequential memory access
@@ -39,6 +41,7 @@ For each heap access, it could be
 MAX_ADDR = 0xffffffff
 MIN_STACK_ADDR = MAX_ADDR - 4 * 1024 * 1024  # 4 MB max stack space
 CODE_SIZE = 4 * 1024 * 1024  # 4 MB static data
+MAX_PAGE_SHIFT = 29  # largest allocation: 512 MB
 
 
 class Process:
@@ -154,7 +157,7 @@ class Process:
 
         return: page size
         '''
-        avaiable_page_sizes = [2**i for i in range(13, 30)]
+        avaiable_page_sizes = [2**i for i in range(13, MAX_PAGE_SHIFT + 1)]
         avaiable_page_sizes = list(
             filter(lambda s: (s <= self.MAX_MEMORY - self.heap_size) and ((self.heap_size + CODE_SIZE) % s == 0),
                    avaiable_page_sizes))
@@ -208,8 +211,15 @@ def main() -> None:
     parser = argparse.ArgumentParser()
     parser.add_argument('num_tests', type = int, help='Num of tests generated')
     parser.add_argument('process_configs', nargs='+', type=parse_process_params)
+    parser.add_argument('--address-bits', type=int, choices=[32, 48, 57], default=32,
+                        help='Width of virtual addresses (default 32)')
 
     args = parser.parse_args()
+    global MAX_ADDR, MIN_STACK_ADDR, MAX_PAGE_SHIFT
+    MAX_ADDR = 2**args.address_bits - 1
+    MIN_STACK_ADDR = MAX_ADDR - 4 * 1024 * 1024
+    if args.address_bits > 32:
+        MAX_PAGE_SHIFT = 30
     num_tests = args.num_tests
     process_configs = args.process_configs
     processes = []
@@ -0,0 +1,123 @@
+#include <utility>
+#include <algorithm>
+#include "ThreadPool.h"
+
+using namespace std;
+
+// index of the calling worker's own deque, -1 outside the pool
+static thread_local long currentWorker = -1;
+
+// 1. constructor
+ThreadPool::ThreadPool(size_t numThreads) {
+    if (numThreads == 0) {
+        numThreads = max(1u, thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < numThreads; i++) {
+        queues.emplace_back(new WorkerQueue());
+    }
+    for (size_t i = 0; i < numThreads; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+// 2. destructor
+//    finish the queued work, then join
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> guard(stateLock);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+// 3. submit
+//    a worker keeps the tasks it spawns, other callers go round-robin
+void ThreadPool::submit(function<void()> task) {
+    size_t target;
+    {
+        lock_guard<mutex> guard(stateLock);
+        target = currentWorker >= 0 ? currentWorker : nextQueue++ % queues.size();
+    }
+    {
+        lock_guard<mutex> guard(queues[target]->lock);
+        queues[target]->tasks.push_back(move(task));
+    }
+    {
+        lock_guard<mutex> guard(stateLock);
+        queued++;
+        pending++;
+    }
+    workAvailable.notify_one();
+}
+
+// 4. wait
+void ThreadPool::wait() {
+    unique_lock<mutex> guard(stateLock);
+    allDone.wait(guard, [this] { return pending == 0; });
+    if (firstError) {
+        exception_ptr error = firstError;
+        firstError = nullptr;
+        rethrow_exception(error);
+    }
+}
+
+// own deque from the back (most recent, still warm), then steal from the front of the others
+bool ThreadPool::popTask(size_t self, function<void()>& task) {
+    {
+        WorkerQueue& own = *queues[self];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); i++) {
+        WorkerQueue& victim = *queues[(self + i) % queues.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t self) {
+    currentWorker = self;
+    while (true) {
+        {
+            unique_lock<mutex> guard(stateLock);
+            workAvailable.wait(guard, [this] { return queued > 0 || stopping; });
+            if (queued == 0) {
+                return;   // stopping and drained
+            }
+        }
+        function<void()> task;
+        if (!popTask(self, task)) {
+            continue;     // another worker got there first
+        }
+        {
+            lock_guard<mutex> guard(stateLock);
+            queued--;
+        }
+        try {
+            task();
+        } catch (...) {
+            lock_guard<mutex> guard(stateLock);
+            if (!firstError) {
+                firstError = current_exception();
+            }
+        }
+        {
+            lock_guard<mutex> guard(stateLock);
+            if (--pending == 0) {
+                allDone.notify_all();
+            }
+        }
+    }
+}
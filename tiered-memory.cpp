@@ -0,0 +1,109 @@
+#include <stdexcept>
+#include <string>
+#include "TieredMemory.h"
+
+using namespace std;
+
+const size_t frameBytes = 4096;
+
+// 1. constructor
+//    tiers are laid out back to back from pfn 0
+TieredMemory::TieredMemory(const vector<MemoryTierConfig>& tiers, PlacementPolicy placement, int pfnBits)
+    : tiers(tiers), placement(placement) {
+    if (tiers.empty()) {
+        throw invalid_argument("Tiered memory needs at least one tier");
+    }
+    size_t maxFrames = size_t(1) << pfnBits;
+    size_t firstPfn = 0;
+    allocators.reserve(tiers.size());
+    for (const MemoryTierConfig& tier : tiers) {
+        size_t frames = tier.capacity / frameBytes;
+        if (frames == 0 || firstPfn + frames > maxFrames) {
+            throw invalid_argument("Memory tier " + tier.name + " is empty or exceeds the " +
+                                   to_string((maxFrames * frameBytes) >> 30) + "GB physical space");
+        }
+        allocators.emplace_back(frames, firstPfn);
+        firstPfn += frames;
+    }
+}
+
+// 2. allocation
+uint32_t TieredMemory::allocate(int order) {
+    size_t count = tiers.size();
+    size_t first = 0;
+    if (placement == PLACE_INTERLEAVE) {
+        first = nextTier;
+        nextTier = (nextTier + 1) % count;
+    }
+    for (size_t i = 0; i < count; i++) {
+        size_t tier = placement == PLACE_SLOW_FIRST ? count - 1 - i : (first + i) % count;
+        uint32_t pfn = allocators[tier].allocate(order);
+        if (pfn != NO_FRAME) {
+            return pfn;
+        }
+    }
+    return NO_FRAME;
+}
+
+uint32_t TieredMemory::allocateIn(int order, size_t tier) {
+    return tier < allocators.size() ? allocators[tier].allocate(order) : NO_FRAME;
+}
+
+// 3. per-frame operations go to the owning tier
+void TieredMemory::free(uint32_t pfn) {
+    size_t tier = tierOf(pfn);
+    if (tier == tiers.size()) {
+        throw logic_error("Freeing a frame outside physical memory");
+    }
+    allocators[tier].free(pfn);
+}
+
+void TieredMemory::split(uint32_t pfn) {
+    size_t tier = tierOf(pfn);
+    if (tier == tiers.size()) {
+        throw logic_error("Splitting a frame outside physical memory");
+    }
+    allocators[tier].split(pfn);
+}
+
+bool TieredMemory::isAllocated(uint32_t pfn) const {
+    size_t tier = tierOf(pfn);
+    return tier < tiers.size() && allocators[tier].isAllocated(pfn);
+}
+
+int TieredMemory::blockOrder(uint32_t pfn) const {
+    size_t tier = tierOf(pfn);
+    return tier < tiers.size() ? allocators[tier].blockOrder(pfn) : -1;
+}
+
+uint32_t TieredMemory::peekFree() const {
+    for (const BuddyAllocator& allocator : allocators) {
+        uint32_t pfn = allocator.peekFree();
+        if (pfn != NO_FRAME) {
+            return pfn;
+        }
+    }
+    return NO_FRAME;
+}
+
+size_t TieredMemory::freeBytes() const {
+    size_t bytes = 0;
+    for (const BuddyAllocator& allocator : allocators) {
+        bytes += allocator.freeBytes();
+    }
+    return bytes;
+}
+
+size_t TieredMemory::freeBytes(size_t tier) const {
+    return allocators[tier].freeBytes();
+}
+
+// a handful of tiers: a linear scan is as fast as anything else
+size_t TieredMemory::tierOf(uint32_t pfn) const {
+    for (size_t tier = 0; tier < allocators.size(); tier++) {
+        if (allocators[tier].contains(pfn)) {
+            return tier;
+        }
+    }
+    return tiers.size();
+}
@@ -0,0 +1,88 @@
+#include "TlbPrefetcher.h"
+
+using namespace std;
+
+// negative page numbers are dropped, the os drops the ones beyond the address space
+static void add_candidate(vector<uint64_t>& candidates, int64_t vpn) {
+  if (vpn >= 0) {
+    candidates.push_back(vpn);
+  }
+}
+
+// 1. sequential
+void SequentialPrefetcher::on_miss(uint32_t process_id, uint64_t miss_vpn, uint64_t page_vpn, uint32_t page_pages,
+                                   vector<uint64_t>& candidates) {
+  candidates.clear();
+  for (uint32_t i = 1; i <= degree; i++) {
+    add_candidate(candidates, int64_t(page_vpn) + int64_t(page_pages) * i);
+  }
+}
+
+// 2. stride
+void StridePrefetcher::on_miss(uint32_t process_id, uint64_t miss_vpn, uint64_t page_vpn, uint32_t page_pages,
+                               vector<uint64_t>& candidates) {
+  candidates.clear();
+  History& h = history[process_id];
+  int64_t stride = int64_t(miss_vpn) - int64_t(h.last_vpn);
+  if (h.primed && stride != 0 && stride == h.last_stride) {
+    for (uint32_t i = 1; i <= degree; i++) {
+      add_candidate(candidates, int64_t(miss_vpn) + stride * i);
+    }
+  }
+  h.last_stride = h.primed ? stride : 0;
+  h.last_vpn = miss_vpn;
+  h.primed = true;
+}
+
+// 3. distance
+DistancePrefetcher::DistancePrefetcher(uint32_t degree, uint32_t rows) : degree(degree), table(rows) {}
+
+DistancePrefetcher::Row& DistancePrefetcher::row(int64_t distance) {
+  uint64_t hash = uint64_t(distance) * 0x9E3779B97F4A7C15ull;
+  return table[(hash >> 32) % table.size()];
+}
+
+void DistancePrefetcher::on_miss(uint32_t process_id, uint64_t miss_vpn, uint64_t page_vpn, uint32_t page_pages,
+                                 vector<uint64_t>& candidates) {
+  candidates.clear();
+  History& h = history[process_id];
+  int64_t distance = int64_t(miss_vpn) - int64_t(h.last_vpn);
+  if (h.misses >= 2) {
+    // the previous distance was followed by this one
+    Row& prev = row(h.last_distance);
+    if (!prev.valid || prev.distance != h.last_distance) {
+      prev = Row();
+      prev.valid = true;
+      prev.distance = h.last_distance;
+    }
+    if (prev.count == 0 || prev.next[0] != distance) {
+      prev.next[1] = prev.next[0];
+      prev.next[0] = distance;
+      prev.count = prev.count < 2 ? prev.count + 1 : 2;
+    }
+  }
+  if (h.misses >= 1) {
+    Row& current = row(distance);
+    if (current.valid && current.distance == distance) {
+      for (uint32_t i = 0; i < current.count && i < degree; i++) {
+        add_candidate(candidates, int64_t(miss_vpn) + current.next[i]);
+      }
+    }
+    h.last_distance = distance;
+  }
+  h.last_vpn = miss_vpn;
+  h.misses++;
+}
+
+TlbPrefetcher* make_tlb_prefetcher(TlbPrefetchKind kind, uint32_t degree) {
+  switch (kind) {
+  case TLB_PREFETCH_SEQUENTIAL:
+    return new SequentialPrefetcher(degree);
+  case TLB_PREFETCH_STRIDE:
+    return new StridePrefetcher(degree);
+  case TLB_PREFETCH_DISTANCE:
+    return new DistancePrefetcher(degree);
+  default:
+    return nullptr;
+  }
+}
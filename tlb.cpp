@@ -1,368 +1,723 @@
-#include <iostream>
-#include <algorithm>
-#include "tlb.h"
-
-int L1_hit = 0;
-int L2_hit = 0;
-int TLB_miss = 0;
-
-// constructor
-TlbEntry::TlbEntry(uint32_t process_id, uint32_t page_size, uint32_t vpn, uint32_t pfn) : process_id(process_id),page_size(page_size),vpn(vpn), pfn(pfn), reference(1) {}
-
-
-//two-level tlb
-// constructor
-Tlb::Tlb(uint32_t l1_size, uint32_t l2_size, uint32_t max_process_allowed) : l1_size(l1_size), l2_size(l2_size), max_process_allowed(max_process_allowed) {
-  // by default: l1 size 64, l2 size 1024, max process allowed is 4
-  l1_list = new vector<TlbEntry>();
-  l2_list = new vector<vector<TlbEntry>*>();
-
-  l2_size_per_process = l2_size / max_process_allowed;
-  for (int i = 0; i < max_process_allowed; i++) {
-    l2_list->push_back(new vector<TlbEntry>());
-  }
-  
-  srand(time(NULL));
-  cout << "TLB initialized" << endl;
-}
-
-// destructor
-Tlb::~Tlb() {
-  delete l1_list;
-  for (int i=0; i<max_process_allowed; i++) {
-    delete (*l2_list)[i];
-  }
-  delete l2_list;
-}
-
-
-// pfn and page_size is obtained from page table entry obj
-TlbEntry Tlb::create_tlb_entry(uint32_t pfn, uint32_t page_size, uint32_t virtual_addr, uint32_t process_id) {
-  // calculate mask: number of bits to right shift to extract vpn.
-  // e.g. set mask to 12 when page size is 4KB and physical mem is 4GB (thus 20-bit vpn).
-  uint32_t mask = ~(page_size - 1);
-  uint32_t vpn = (virtual_addr & mask) >> 12;
-
-  TlbEntry tlb_entry = TlbEntry(process_id, page_size, vpn, pfn);
-  return tlb_entry;
-}
-
-
-// look_up(): given a virtual addr, look it up in both l1 and l2
-// return pfn if found, -1 if miss
-int Tlb::look_up(uint32_t virtual_addr, uint32_t process_id) {
-  // first, check l1
-  // loop through l1, compute the virtual addr vpn using tlb entry page size, and compare the 2 vpns
-  for (int i = 0; i < l1_list->size(); i++) {
-    uint32_t page_size = (*l1_list)[i].page_size;
-    uint32_t mask = ~(page_size - 1);
-    uint32_t vpn = (virtual_addr & mask) >> 12;
-    if (vpn == (*l1_list)[i].vpn) {
-      L1_hit++;
-      
-      return (*l1_list)[i].pfn;
-    }
-  }
-
-  // If only 1 level TLB is supported, uncomment this
-  /*
-  TLB_miss++;
-  L1_hit--;
-  throw logic_error("TLB miss");
-  */
-
-  // not in l1, check l2:
-  // first, check if the process is already in l2
-  for (int i = 0; i < l2_list->size(); i++) {
-    if ((*l2_list)[i]->empty())
-      continue;
-    if ((*l2_list)[i]->back().process_id != process_id)
-      continue;
-    for (int j = 0; j < (*l2_list)[i]->size(); j++) {
-      TlbEntry entry = (*((*l2_list)[i]))[j];
-      uint32_t page_size = entry.page_size;
-      uint32_t mask = ~(page_size - 1);
-      uint32_t vpn = (virtual_addr & mask) >> 12;
-      if (vpn == entry.vpn) {
-        // found in l2, insert this one into l1
-        l1_insert(entry);
-        L2_hit++;
-        return entry.pfn;
-      }
-    }
-  }
-  // otherwise, l2 miss, go to page table with virtual addr and get a page table entry
-  TLB_miss++;
-  L1_hit--;
-  throw logic_error("TLB miss");
-}
-
-
-// upon TLB hit, assemble physical address: use pfn and offset to form a physicai address
-uint32_t Tlb::assemble_physical_addr(TlbEntry tlb_entry, uint32_t virtual_addr) {
-  // get the offset length based on page size
-  uint32_t page_size = tlb_entry.page_size;
-  uint32_t offset_length = log2(page_size);
-
-  // get the value of offset
-  uint32_t mask = (1 << offset_length) - 1;
-  uint32_t offset = virtual_addr & mask;
-
-  // assembly pfn + offset
-  uint32_t pfn = tlb_entry.pfn;
-  uint32_t physical_addr = (pfn << offset_length) | offset;
-  return physical_addr;
-}
-
-// TLBs: insert a tlb entry into l1
-// return -1 if no replacement occurs, return the replaced index in l1 if replacement occurs.
-int Tlb::l1_insert(TlbEntry entry) {
-  if(l1_list->size() < l1_size) {
-    l1_list->push_back(entry);
-    return -1;
-  } else {
-    // l1 is full, pick a random one to replace
-    int random = random_generator(0, l1_size-1);
-    (*l1_list)[random] = entry;
-    return random;
-  }
-}
-
-// TLBs: insert a tlb entry into l1 using FIFO policy
-// return -1 if no replacement occurs, return the replaced index in l1 if replacement occurs.
-int Tlb::l1_insert(TlbEntry entry, int fifo) {
-  if(l1_list->size() < l1_size) {
-    l1_list->push_back(entry);
-    return -1;
-  } else {
-    // l1 is full, kick the first element out
-    l1_list->erase(l1_list->begin());
-    l1_list->push_back(entry);
-    return 0;  // return the index of replaced element
-  }
-}
-
-//flush all
-void Tlb::l1_flush() {
-  while (l1_list->size() != 0) {
-    l1_list->pop_back();
-  }
-}
-
-// default: maximum 256 entries allowed per process
-void Tlb::l2_insert(TlbEntry entry) {
-    // std::find_if() is used for searching a range defined by iterators for the first element that satisfies a specific condition.
-    // check if that process is already in tlb l2 list
-    auto iter = find_if(l2_list->begin(), l2_list->end(), [entry](const vector<TlbEntry>* procTlb) {
-        return !procTlb->empty() && procTlb->back().process_id == entry.process_id;
-    });
-    vector<TlbEntry>* toReplace = nullptr;
-    if (iter == l2_list->end()) {
-        // the process is not in l2 tlb
-        // find the first empty proTlb (sub l2 tlb)
-        auto iter = find_if(l2_list->begin(), l2_list->end(), [](const vector<TlbEntry>* procTlb) {
-            return procTlb->empty();
-        });
-        if (iter == l2_list->end()) {
-            // no empty sub list is found, reached max_process_allowed
-            // pick a random sub list and flush all the enties of that sub list
-            auto idx = random_generator(0, max_process_allowed);
-            toReplace = (*l2_list)[idx];
-            toReplace->clear();
-        } else {
-            // an empty sub list is found
-            toReplace = *iter;
-        }
-    } else {
-      // the process is already in l2 tlb
-        toReplace = *iter;
-    }
-    if (toReplace->size() == l2_size_per_process) {
-      // the sub l2 is already full, pick a random one to replace
-        int idx = random_generator(0, l2_size_per_process);
-        (*toReplace)[idx] = entry;
-    } else {
-      // sub l2 is not null, push back
-        toReplace->push_back(entry);
-    }
-}
-
-void Tlb::l2_insert(TlbEntry entry, int fifo) {
-    // std::find_if() is used for searching a range defined by iterators for the first element that satisfies a specific condition.
-    // check if that process is already in tlb l2 list
-    auto iter = find_if(l2_list->begin(), l2_list->end(), [entry](const vector<TlbEntry>* procTlb) {
-        return !procTlb->empty() && procTlb->back().process_id == entry.process_id;
-    });
-    vector<TlbEntry>* toReplace = nullptr;
-    if (iter == l2_list->end()) {
-        // the process is not in l2 tlb
-        // find the first empty proTlb (sub l2 tlb)
-        auto iter = find_if(l2_list->begin(), l2_list->end(), [](const vector<TlbEntry>* procTlb) {
-            return procTlb->empty();
-        });
-        if (iter == l2_list->end()) {
-            // no empty sub list is found, reached max_process_allowed
-            // delete the first sub list and insert a new empty sub list at the end
-            delete l2_list->front();
-            l2_list->erase(l2_list->begin());
-            l2_list->push_back(new vector<TlbEntry>());
-            toReplace = l2_list->back();
-        } else {
-            // an empty sub list is found
-            toReplace = *iter;
-        }
-    } else {
-      // the process is already in l2 tlb
-        toReplace = *iter;
-    }
-    if (toReplace->size() == l2_size_per_process) {
-      // the sub l2 is already full, pick the first one to remove, and insert at the end (FIFO)
-        toReplace->erase(toReplace->begin());
-        toReplace->push_back(entry);
-    } else {
-      // sub l2 is not null, push back
-        toReplace->push_back(entry);
-    }
-}
-
-// int Tlb::replacingPolicy(int size) {
-//     return random_generator(0, l2_size_per_process);
-// }
-
-
-void Tlb::invalidate_tlb(uint32_t process_id, uint32_t vpn) {
-  l1_remove(process_id, vpn);
-  l2_remove(process_id, vpn);
-  return;
-}
-
-// when a page is swapped out from RAM, delete (invalidate) the corresponding tlb entry
-void Tlb::l1_remove(uint32_t process_id, uint32_t vpn) {
-  for (int i = 0; i < l1_list->size(); i++) {
-    if ( (*l1_list)[i].process_id == process_id ) {
-      if ( (*l1_list)[i].vpn == vpn ) {
-        // remove the tlb entry
-        l1_list->erase(l1_list->begin() + i);
-        return;
-      }
-    }
-    else {
-      // process not match
-      return;
-    }
-  }
-}
-
-// when a page is swapped out from RAM, delete (invalidate) the corresponding tlb entry
-void Tlb::l2_remove(uint32_t process_id, uint32_t vpn) {
-  // check if process is in l2 
-  for (int i = 0; i < l2_list->size(); i++) {
-    vector<TlbEntry>* sub_process = (*l2_list)[i];
-    if (!sub_process->empty()) {
-      if (sub_process->back().process_id == process_id) {
-        for (int j = 0; j < sub_process->size(); j++) {
-          if ((*sub_process)[j].vpn == vpn) {
-            sub_process->erase(sub_process->begin() + j);
-            return;
-          }
-        }
-      }
-    }
-  }
-  // otherwise, process not in l2 or process_id not found
-  return;
-}
-
-int Tlb::random_generator(uint32_t start, uint32_t end) {
-  int span = end - start;
-  int random = rand() % span + start;
-  return random;
-}
-
-PTEntry::PTEntry(uint32_t page_size, uint32_t pfn):page_size(page_size),pfn(pfn) {}
-
-
-// test FIFO
-// test tlb look up return value
-/*
-int main() {
-
-    // test FIFO insert and invalidate_tlb
-    // params: l1 size, l2 size, max allowed
-    Tlb* tlb = new Tlb(64, 1024, 4);
-    // params: pid, pz, vpn, pfn
-
-    TlbEntry a = TlbEntry(1, 4096, 30, 60);
-    TlbEntry b = TlbEntry(1, 4096, 31, 61);
-    TlbEntry c = TlbEntry(1, 4096, 32, 62);
-    cout << "test l1 FIFO insert" << endl;
-    tlb->l1_insert(a,0); // a will disappear
-    for (int i=0; i<63; i++) {
-      tlb->l1_insert(b,0);
-    }
-    tlb->l1_insert(c,0);  // c will be the end
-
-    for (int i=0; i<tlb->l1_list->size(); i++) {
-      vector <TlbEntry>* temp = tlb->l1_list;
-      cout << (*temp)[i].vpn << endl;
-    }
-
-
-    cout << "test l2 FIFO insert" << endl;
-    tlb->l2_insert(a,0);
-    for (int i=0; i<255; i++) {
-      tlb->l2_insert(b,0);  //pid 5
-    }
-    tlb->l2_insert(c,0);
-
-    vector <vector <TlbEntry>*>* l2 = tlb->l2_list;
-    vector <TlbEntry>* temp = (*l2)[0];
-    cout << temp->front().vpn << endl; // expected 31
-    cout << temp->back().vpn << endl;  // expected 32
-
-    // TlbEntry a = TlbEntry(1, 4096, 30, 60);
-    // TlbEntry b = TlbEntry(1, 4096, 31, 61);
-    // TlbEntry c = TlbEntry(1, 4096, 32, 62);
-    // TlbEntry d = TlbEntry(1, 4096, 33, 63);
-    // TlbEntry e = TlbEntry(1, 4096, 34, 64);
-
-    // tlb->l1_insert(a,0);
-    // tlb->l1_insert(b,0);
-    // tlb->l1_insert(c,0);
-    // tlb->l1_insert(d,0);
-    // tlb->l1_insert(e,0);
-    // tlb->l2_insert(a,0);
-    // tlb->l2_insert(b,0);
-    // tlb->l2_insert(c,0);
-    // tlb->l2_insert(d,0);
-    // tlb->l2_insert(e,0);
-
-    // TlbEntry aa = TlbEntry(2, 4096, 30, 60);
-    // TlbEntry bb = TlbEntry(2, 4096, 31, 61);
-    // TlbEntry cc = TlbEntry(2, 4096, 32, 62);
-    // TlbEntry dd = TlbEntry(2, 4096, 33, 63);
-    // TlbEntry ee = TlbEntry(2, 4096, 34, 64);
-
-    // tlb->l2_insert(aa,0);
-    // tlb->l2_insert(bb,0);
-    // tlb->l2_insert(cc,0);
-    // tlb->l2_insert(dd,0);
-    // tlb->l2_insert(ee,0);
-
-    // tlb->invalidate_tlb(1, 33); //process_id, vpn
-    
-    // cout << tlb->l1_list->size() << endl;  // expected 4
-    // cout << (*tlb->l2_list)[0]->size() << endl;  // expected 4
-    // cout << (*tlb->l2_list)[1]->size() << endl;  // expected 5
-
-    // tlb->invalidate_tlb(2, 34);
-    // cout << (*tlb->l2_list)[1]->size() << endl;  // expected 4
-
-    delete tlb;
-
-    
-
-    cout << "No error occurs" << endl;
-    return 0;
-}
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include "tlb.h"
+
+// constructor
+TlbEntry::TlbEntry(uint32_t process_id, uint32_t page_size, uint64_t vpn, uint32_t pfn) : process_id(process_id),page_size(page_size),vpn(vpn), pfn(pfn) {}
+
+
+//two-level tlb
+// constructor
+Tlb::Tlb(uint32_t l1_size, uint32_t l2_size, uint32_t max_process_allowed)
+  : Tlb(TlbConfig{l1_size, l2_size, max_process_allowed}, nullptr) {}
+
+Tlb::Tlb(const TlbConfig& config, SimStats* stats)
+  : l1_size(config.l1_size), l2_size(config.l2_size), max_process_allowed(config.max_process_allowed),
+    l2_policy(config.l2_policy), stats(stats ? stats : &own_stats), rng(config.seed ? config.seed : time(NULL)),
+    asid_bits(config.asid_bits), next_asid(0) {
+  if (asid_bits > 16) {
+    throw invalid_argument("ASID width must be at most 16 bits");
+  }
+  // by default: l1 size 64, l2 size 1024, max process allowed is 4
+  l1 = make_tlb_level(l1_size, config.l1_ways, config.index_hash, config.l1_policy, &rng);
+  if (config.l2_partitioning == TLB_L2_UCP) {
+    l2_shared = new UcpTlb(l2_size, config.l2_ways, config.index_hash, config.ucp_epoch, this->stats);
+  } else if (config.l2_ways) {
+    l2_shared = make_tlb_level(l2_size, config.l2_ways, config.index_hash, config.l2_policy, &rng);
+  } else {
+    l2_shared = nullptr;
+  }
+
+  prefetch_buffer = config.prefetch_buffer
+      ? make_tlb_level(config.prefetch_buffer, 0, config.index_hash, TLB_REPLACE_FIFO, &rng) : nullptr;
+  pde_cache = config.pde_cache_size
+      ? make_tlb_level(config.pde_cache_size, config.pde_cache_ways, config.index_hash,
+                       config.pde_cache_policy, &rng) : nullptr;
+
+  l2_size_per_process = l2_size / max_process_allowed;
+  if (!l2_shared) {
+    for (int i = 0; i < max_process_allowed; i++) {
+      l2_partitions.push_back(make_tlb_level(l2_size_per_process, 0, config.index_hash, config.l2_policy, &rng));
+      l2_owner.push_back(-1);
+    }
+  }
+}
+
+// destructor
+Tlb::~Tlb() {
+  delete l1;
+  delete l2_shared;
+  delete prefetch_buffer;
+  delete pde_cache;
+  for (TlbLevel* partition : l2_partitions) {
+    delete partition;
+  }
+}
+
+// pfn, page_size and vpn are obtained from page table entry obj
+TlbEntry Tlb::create_tlb_entry(uint32_t pfn, uint32_t page_size, uint64_t vpn, uint32_t process_id) {
+  TlbEntry tlb_entry = TlbEntry(process_id, page_size, vpn, pfn);
+  return tlb_entry;
+}
+
+
+// lookup(): given a virtual addr, look it up in l1 then l2
+// the result carries the hit level, pfn and page size, misses are reported with TLB_LEVEL_MISS
+TlbLookupResult Tlb::lookup(uint64_t virtual_addr, uint32_t process_id) {
+  // first, check l1
+  TlbEntry* hit = l1->find(virtual_addr, l1_tag(process_id));
+  if (hit) {
+    stats->L1_hit++;
+    return TlbLookupResult{TLB_LEVEL_L1, hit->pfn, hit->page_size, hit->vpn};
+  }
+
+  // If only 1 level TLB is supported, uncomment this
+  /*
+  stats->TLB_miss++;
+  return TlbLookupResult{TLB_LEVEL_MISS, 0, 0, 0};
+  */
+
+  // not in l1, check l2: the shared set-associative array, or the partition of this process
+  if (l2_shared) {
+    hit = l2_shared->find(virtual_addr, process_id);
+  } else {
+    int partition = l2_partition_of(process_id);
+    hit = partition >= 0 ? l2_partitions[partition]->find(virtual_addr, process_id) : nullptr;
+  }
+  if (hit) {
+    if (hit->prefetched) {
+      stats->prefetch_useful++;
+      hit->prefetched = false;
+    }
+    // found in l2, insert this one into l1
+    TlbEntry entry = *hit;
+    l1_insert(entry);
+    stats->L2_hit++;
+    return TlbLookupResult{TLB_LEVEL_L2, entry.pfn, entry.page_size, entry.vpn};
+  }
+  // the prefetch buffer sits next to l2: a hit moves the entry into l1 and l2
+  hit = prefetch_buffer ? prefetch_buffer->find(virtual_addr, process_id) : nullptr;
+  if (hit) {
+    TlbEntry entry = *hit;
+    entry.prefetched = false;
+    prefetch_buffer->remove(entry.process_id, entry.vpn);
+    stats->prefetch_useful++;
+    fill(entry);
+    stats->L2_hit++;
+    return TlbLookupResult{TLB_LEVEL_L2, entry.pfn, entry.page_size, entry.vpn};
+  }
+  // otherwise, l2 miss, the caller walks the page table and calls fill()
+  stats->TLB_miss++;
+  return TlbLookupResult{TLB_LEVEL_MISS, 0, 0, 0};
+}
+
+// look_up(): given a virtual addr, look it up in both l1 and l2
+// return pfn if found, -1 if miss
+int Tlb::look_up(uint64_t virtual_addr, uint32_t process_id) {
+  TlbLookupResult result = lookup(virtual_addr, process_id);
+  return result.hit() ? (int)result.pfn : -1;
+}
+
+// after a miss, install the translation in both levels
+void Tlb::fill(const TlbEntry& entry) {
+  l1_insert(entry);
+  l2_insert(entry);
+}
+
+
+// upon TLB hit, assemble physical address: use pfn and offset to form a physicai address
+uint64_t Tlb::assemble_physical_addr(TlbEntry tlb_entry, uint64_t virtual_addr) {
+  // offset of the address inside the page, the page starts at vpn
+  uint64_t offset = virtual_addr - (tlb_entry.vpn << 12);
+
+  // first frame of the page + offset
+  uint64_t physical_addr = (uint64_t(tlb_entry.pfn) << 12) + offset;
+  return physical_addr;
+}
+
+void Tlb::prefetch_fill(const TlbEntry& entry) {
+  TlbEntry prefetched = entry;
+  prefetched.prefetched = true;
+  if (prefetch_buffer) {
+    prefetch_buffer->insert(prefetched);
+  } else {
+    l2_insert(prefetched);
+  }
+}
+
+bool Tlb::contains(uint64_t virtual_addr, uint32_t process_id) {
+  if (l1->contains(virtual_addr, l1_tag(process_id))) {
+    return true;
+  }
+  if (l2_shared) {
+    if (l2_shared->contains(virtual_addr, process_id)) {
+      return true;
+    }
+  } else {
+    int partition = l2_partition_of(process_id);
+    if (partition >= 0 && l2_partitions[partition]->contains(virtual_addr, process_id)) {
+      return true;
+    }
+  }
+  return prefetch_buffer && prefetch_buffer->contains(virtual_addr, process_id);
+}
+
+// TLBs: insert a tlb entry into l1
+// return -1 if no replacement occurs, return the replaced slot in l1 if replacement occurs.
+int Tlb::l1_insert(const TlbEntry& entry) {
+  TlbEntry tagged = entry;
+  tagged.prefetched = false;
+  tagged.process_id = l1_tag(entry.process_id);
+  return l1->insert(tagged);
+}
+
+//flush all
+void Tlb::l1_flush() {
+  l1->flush();
+  stats->l1_flushes++;
+}
+
+bool Tlb::switch_process(uint32_t process_id) {
+  stats->context_switches++;
+  if (asid_bits == 0) {
+    // l1 entries belong to the previous address space
+    l1_flush();
+    return true;
+  }
+  if (asid_of.count(process_id)) {
+    return false;
+  }
+  uint64_t flushes = stats->l1_flushes;
+  assign_asid(process_id);
+  return stats->l1_flushes != flushes;
+}
+
+uint32_t Tlb::l1_tag(uint32_t process_id) {
+  if (asid_bits == 0) {
+    return process_id;
+  }
+  auto it = asid_of.find(process_id);
+  return it != asid_of.end() ? it->second : assign_asid(process_id);
+}
+
+uint32_t Tlb::assign_asid(uint32_t process_id) {
+  if (next_asid == (1u << asid_bits)) {
+    // asid space wrapped: every tag may now be reused, so nothing cached in l1 can be trusted
+    l1_flush();
+    asid_of.clear();
+    next_asid = 0;
+  }
+  asid_of[process_id] = next_asid;
+  return next_asid++;
+}
+
+int Tlb::l2_partition_of(uint32_t process_id) const {
+  for (size_t i = 0; i < l2_owner.size(); i++) {
+    if (l2_owner[i] == process_id) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// default: maximum 256 entries allowed per process
+void Tlb::l2_insert(const TlbEntry& entry) {
+    if (l2_shared) {
+        l2_shared->insert(entry);
+        return;
+    }
+    // check if that process already owns a partition
+    int partition = l2_partition_of(entry.process_id);
+    if (partition < 0) {
+        // the process is not in l2 tlb, take the first free partition
+        auto iter = find(l2_owner.begin(), l2_owner.end(), -1);
+        if (iter != l2_owner.end()) {
+            partition = iter - l2_owner.begin();
+        } else if (l2_policy == TLB_REPLACE_RANDOM) {
+            // reached max_process_allowed: flush a random partition
+            partition = random_generator(0, max_process_allowed);
+        } else {
+            // reached max_process_allowed: flush the oldest partition and rotate it to the end
+            rotate(l2_partitions.begin(), l2_partitions.begin() + 1, l2_partitions.end());
+            rotate(l2_owner.begin(), l2_owner.begin() + 1, l2_owner.end());
+            partition = l2_partitions.size() - 1;
+        }
+        l2_partitions[partition]->flush();
+        l2_owner[partition] = entry.process_id;
+    }
+    l2_partitions[partition]->insert(entry);
+}
+
+void Tlb::invalidate_tlb(uint32_t process_id, uint64_t vpn) {
+  l1_remove(process_id, vpn);
+  l2_remove(process_id, vpn);
+  if (prefetch_buffer) {
+    prefetch_buffer->remove(process_id, vpn);
+  }
+  return;
+}
+
+// page-walk cache: one 4MB entry per cached directory slot
+static const uint32_t pde_span = 4096u << 10;
+
+bool Tlb::pde_lookup(uint32_t process_id, uint64_t dir_index) {
+  return pde_cache && pde_cache->find(dir_index << 22, process_id);
+}
+
+void Tlb::pde_fill(uint32_t process_id, uint64_t dir_index) {
+  if (pde_cache) {
+    pde_cache->insert(TlbEntry(process_id, pde_span, dir_index << 10, 0));
+  }
+}
+
+void Tlb::pde_invalidate(uint32_t process_id, uint64_t dir_index) {
+  if (pde_cache) {
+    pde_cache->remove(process_id, dir_index << 10);
+  }
+}
+
+// when a page is swapped out from RAM, delete (invalidate) the corresponding tlb entry
+void Tlb::l1_remove(uint32_t process_id, uint64_t vpn) {
+  if (asid_bits == 0) {
+    l1->remove(process_id, vpn);
+    return;
+  }
+  // a process without a current asid has nothing in l1
+  auto it = asid_of.find(process_id);
+  if (it != asid_of.end()) {
+    l1->remove(it->second, vpn);
+  }
+}
+
+// when a page is swapped out from RAM, delete (invalidate) the corresponding tlb entry
+void Tlb::l2_remove(uint32_t process_id, uint64_t vpn) {
+  if (l2_shared) {
+    l2_shared->remove(process_id, vpn);
+    return;
+  }
+  // otherwise, only the partition of the process can hold it
+  int partition = l2_partition_of(process_id);
+  if (partition >= 0) {
+    l2_partitions[partition]->remove(process_id, vpn);
+  }
+}
+
+// uniform in [start, end)
+int Tlb::random_generator(uint32_t start, uint32_t end) {
+  int span = end - start;
+  int random = rng() % span + start;
+  return random;
+}
+
+// tlb array: entries and the page-size bookkeeping shared by every policy
+TlbArrayBase::TlbArrayBase(uint32_t size, uint32_t ways, TlbIndexHash index_hash)
+  : num_sets(ways ? size / ways : 1), ways(ways ? ways : size), index_hash(index_hash),
+    entries(size, TlbEntry(0, 0, 0, 0)), set_live(num_sets, 0), live(0), order_mask(0), unaligned_mask(0) {
+  if (size == 0 || size % this->ways != 0) {
+    throw invalid_argument("TLB size must be a non-zero multiple of its associativity");
+  }
+  fill(begin(order_count), end(order_count), 0);
+  fill(begin(unaligned_count), end(unaligned_count), 0);
+}
+
+uint32_t TlbArrayBase::set_index(uint64_t page_number, uint32_t process_id) const {
+  if (index_hash == TLB_HASH_XOR) {
+    // fold the high bits and the pid into the low bits before taking the set; page numbers
+    // of the 32-bit mode stay below 2^21, only the 64-bit modes have bits to fold from above
+    page_number ^= page_number >> 21;
+    page_number ^= (page_number >> 7) ^ (page_number >> 14) ^ (process_id * 0x9E3779B1u >> 20);
+  }
+  return page_number % num_sets;
+}
+
+uint32_t TlbArrayBase::set_of(const TlbEntry& entry) const {
+  uint32_t order = __builtin_ctz(entry.page_size) - 12;
+  return set_index(entry.vpn >> order, entry.process_id);
+}
+
+int TlbArrayBase::locate(uint64_t virtual_addr, uint32_t process_id) const {
+  if (num_sets == 1) {
+    // fully associative: check whether the virtual addr falls inside any entry's page
+    for (size_t slot = 0; slot < entries.size(); slot++) {
+      const TlbEntry& entry = entries[slot];
+      if (entry.page_size != 0 && entry.process_id == process_id && entry.covers(virtual_addr)) {
+        return slot;
+      }
+    }
+    return -1;
+  }
+  for (uint32_t mask = order_mask; mask != 0; mask &= mask - 1) {
+    uint32_t order = __builtin_ctz(mask);
+    uint64_t window = virtual_addr >> (12 + order);
+    // an unaligned page covering this address may start in the previous window
+    uint32_t probes = (unaligned_mask & (1u << order)) && window > 0 ? 2 : 1;
+    for (uint32_t p = 0; p < probes; p++) {
+      uint32_t first = set_index(window - p, process_id) * ways;
+      for (uint32_t slot = first; slot < first + ways; slot++) {
+        const TlbEntry& entry = entries[slot];
+        if (entry.page_size == (4096u << order) && entry.process_id == process_id && entry.covers(virtual_addr)) {
+          return slot;
+        }
+      }
+    }
+  }
+  return -1;
+}
+
+int TlbArrayBase::locate_vpn(uint32_t process_id, uint64_t vpn) const {
+  for (uint32_t mask = order_mask; mask != 0; mask &= mask - 1) {
+    uint32_t order = __builtin_ctz(mask);
+    uint32_t first = set_index(vpn >> order, process_id) * ways;
+    for (uint32_t slot = first; slot < first + ways; slot++) {
+      const TlbEntry& entry = entries[slot];
+      if (entry.page_size == (4096u << order) && entry.process_id == process_id && entry.vpn == vpn) {
+        return slot;
+      }
+    }
+  }
+  return -1;
+}
+
+int TlbArrayBase::free_slot(uint32_t set) const {
+  if (set_live[set] == ways) {
+    return -1;
+  }
+  uint32_t first = set * ways;
+  for (uint32_t slot = first; slot < first + ways; slot++) {
+    if (entries[slot].page_size == 0) {
+      return slot;
+    }
+  }
+  return -1;
+}
+
+void TlbArrayBase::place(uint32_t slot, const TlbEntry& entry) {
+  entries[slot] = entry;
+  set_live[slot / ways]++;
+  live++;
+  uint32_t order = __builtin_ctz(entry.page_size) - 12;
+  order_count[order]++;
+  order_mask |= 1u << order;
+  if (entry.vpn & ((1u << order) - 1)) {
+    unaligned_count[order]++;
+    unaligned_mask |= 1u << order;
+  }
+}
+
+void TlbArrayBase::drop(uint32_t slot) {
+  TlbEntry& entry = entries[slot];
+  uint32_t order = __builtin_ctz(entry.page_size) - 12;
+  if (--order_count[order] == 0) {
+    order_mask &= ~(1u << order);
+  }
+  if ((entry.vpn & ((1u << order) - 1)) && --unaligned_count[order] == 0) {
+    unaligned_mask &= ~(1u << order);
+  }
+  entry.page_size = 0;
+  set_live[slot / ways]--;
+  live--;
+}
+
+void TlbArrayBase::clear() {
+  for (TlbEntry& entry : entries) {
+    entry.page_size = 0;
+  }
+  fill(set_live.begin(), set_live.end(), 0);
+  live = 0;
+  fill(begin(order_count), end(order_count), 0);
+  fill(begin(unaligned_count), end(unaligned_count), 0);
+  order_mask = 0;
+  unaligned_mask = 0;
+}
+
+// utility-based partitioned l2
+UcpTlb::UcpTlb(uint32_t size, uint32_t ways, TlbIndexHash index_hash, uint32_t epoch, SimStats* stats)
+  : TlbArrayBase(size, ways, index_hash), stamp(size, 0), now(0), epoch(max(epoch, 1u)),
+    epoch_lookups(0), total_lookups(0), unit(max(size / 64, 1u)), stats(stats) {}
+
+// a newcomer starts with an equal share, the others keep theirs scaled down to the rest
+// until the next epoch, so the quotas never add up to more than the l2
+UcpTlb::Tenant& UcpTlb::tenant(uint32_t process_id) {
+  auto it = tenants.find(process_id);
+  if (it == tenants.end()) {
+    uint64_t others = 0;
+    for (auto& item : tenants) {
+      others += item.second.quota;
+    }
+    it = tenants.emplace(process_id, Tenant()).first;
+    uint32_t share = min<uint32_t>(max<uint32_t>(entries.size() / tenants.size(), unit), entries.size());
+    uint64_t rest = entries.size() - share;
+    if (others > rest) {
+      for (auto& item : tenants) {
+        item.second.quota = item.second.quota * rest / others;
+      }
+    }
+    it->second.quota = share;
+  }
+  return it->second;
+}
+
+uint32_t UcpTlb::quota_of(uint32_t process_id) const {
+  auto it = tenants.find(process_id);
+  return it != tenants.end() ? it->second.quota : 0;
+}
+
+uint32_t UcpTlb::set_quota(const Tenant& tenant) const {
+  if (num_sets == 1) {
+    return tenant.quota;
+  }
+  return max<uint32_t>((uint64_t(tenant.quota) * ways + entries.size() / 2) / entries.size(), 1);
+}
+
+TlbEntry* UcpTlb::find(uint64_t virtual_addr, uint32_t process_id) {
+  Tenant& t = tenant(process_id);
+  t.lookups++;
+  total_lookups++;
+  int slot = locate(virtual_addr, process_id);
+  if (slot >= 0) {
+    t.hits++;
+    stamp[slot] = ++now;
+    t.monitor.access(TranslationKey{process_id, entries[slot].vpn});
+  }
+  if (++epoch_lookups >= epoch) {
+    end_epoch();
+  }
+  return slot >= 0 ? &entries[slot] : nullptr;
+}
+
+int UcpTlb::insert(const TlbEntry& entry) {
+  Tenant& t = tenant(entry.process_id);
+  t.monitor.access(TranslationKey{entry.process_id, entry.vpn});
+  uint32_t set = set_of(entry);
+  int slot = free_slot(set);
+  int replaced = -1;
+  if (slot < 0) {
+    slot = choose_victim(set, entry.process_id);
+    tenants[entries[slot].process_id].occupancy--;
+    drop(slot);
+    replaced = slot;
+  }
+  place(slot, entry);
+  stamp[slot] = ++now;
+  t.occupancy++;
+  return replaced;
+}
+
+// lru among the requester's own entries when it is at its quota, otherwise lru among the
+// entries of processes over their quota, plain lru when nobody is over
+uint32_t UcpTlb::choose_victim(uint32_t set, uint32_t process_id) {
+  uint32_t first = set * ways;
+  auto held = [&](uint32_t owner) -> uint32_t {
+    if (num_sets == 1) {
+      return tenants[owner].occupancy;
+    }
+    uint32_t count = 0;
+    for (uint32_t slot = first; slot < first + ways; slot++) {
+      count += entries[slot].process_id == owner;
+    }
+    return count;
+  };
+  uint32_t own = held(process_id);
+  bool replace_own = own > 0 && own >= set_quota(tenants[process_id]);
+  int victim = -1;
+  for (uint32_t slot = first; slot < first + ways; slot++) {
+    uint32_t owner = entries[slot].process_id;
+    bool eligible = replace_own ? owner == process_id : owner != process_id && held(owner) > set_quota(tenants[owner]);
+    if (eligible && (victim < 0 || stamp[slot] < stamp[victim])) {
+      victim = slot;
+    }
+  }
+  if (victim < 0) {
+    victim = first;
+    for (uint32_t slot = first + 1; slot < first + ways; slot++) {
+      if (stamp[slot] < stamp[victim]) {
+        victim = slot;
+      }
+    }
+  }
+  return victim;
+}
+
+void UcpTlb::remove(uint32_t process_id, uint64_t vpn) {
+  int slot = locate_vpn(process_id, vpn);
+  if (slot >= 0) {
+    tenants[process_id].occupancy--;
+    drop(slot);
+  }
+}
+
+void UcpTlb::flush() {
+  clear();
+  fill(stamp.begin(), stamp.end(), 0);
+  for (auto& t : tenants) {
+    t.second.occupancy = 0;
+  }
+}
+
+void UcpTlb::end_epoch() {
+  repartition();
+  for (auto& item : tenants) {
+    Tenant& t = item.second;
+    if (t.lookups > 0 || t.occupancy > 0) {
+      stats->l2Shares.push_back(L2ShareSample{total_lookups, item.first, t.quota, t.occupancy,
+                                              uint32_t(entries.size()), t.lookups, t.hits});
+    }
+    t.lookups = 0;
+    t.hits = 0;
+    t.monitor.decay();
+  }
+  epoch_lookups = 0;
+}
+
+// lookahead allocation: repeatedly grant the block of units with the highest
+// marginal utility (extra monitored hits per unit) until every unit is handed out
+void UcpTlb::repartition() {
+  uint32_t units = entries.size() / unit;
+  vector<Tenant*> order;
+  vector<vector<uint64_t>> utility;      // utility[i][a] = hits of tenant i with a units
+  for (auto& item : tenants) {
+    order.push_back(&item.second);
+    vector<uint64_t> curve(units + 1);
+    for (uint32_t a = 0; a <= units; a++) {
+      curve[a] = item.second.monitor.result().hits(size_t(a) * unit);
+    }
+    utility.push_back(curve);
+  }
+  uint32_t minimum = order.size() <= units ? 1 : 0;
+  vector<uint32_t> alloc(order.size(), minimum);
+  uint32_t balance = units - minimum * order.size();
+  while (balance > 0) {
+    double best_gain = 0;
+    size_t best = 0;
+    uint32_t best_units = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+      for (uint32_t k = 1; k <= balance && alloc[i] + k <= units; k++) {
+        double gain = double(utility[i][alloc[i] + k] - utility[i][alloc[i]]) / k;
+        if (gain > best_gain) {
+          best_gain = gain;
+          best = i;
+          best_units = k;
+        }
+      }
+    }
+    if (best_units == 0) {
+      // nobody gains from more entries: spread the rest evenly
+      for (size_t i = 0; balance > 0; i = (i + 1) % order.size()) {
+        alloc[i]++;
+        balance--;
+      }
+      break;
+    }
+    alloc[best] += best_units;
+    balance -= best_units;
+  }
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i]->quota = alloc[i] * unit;
+  }
+}
+
+TlbLevel* make_tlb_level(uint32_t size, uint32_t ways, TlbIndexHash index_hash,
+                         TlbReplacement policy, mt19937* rng) {
+  switch (policy) {
+  case TLB_REPLACE_RANDOM:
+    return new TlbArray<RandomReplacement>(size, ways, index_hash, rng);
+  case TLB_REPLACE_FIFO:
+    return new TlbArray<FifoReplacement>(size, ways, index_hash, rng);
+  case TLB_REPLACE_LRU:
+    return new TlbArray<LruReplacement>(size, ways, index_hash, rng);
+  case TLB_REPLACE_CLOCK:
+    return new TlbArray<ClockReplacement>(size, ways, index_hash, rng);
+  case TLB_REPLACE_SRRIP:
+    return new TlbArray<SrripReplacement>(size, ways, index_hash, rng);
+  }
+  throw invalid_argument("Unknown TLB replacement policy");
+}
+
+PTEntry::PTEntry(uint32_t page_size, uint32_t pfn):page_size(page_size),pfn(pfn) {}
+
+
+// test FIFO
+// test tlb look up return value
+/*
+int main() {
+
+    // test FIFO insert and invalidate_tlb
+    // params: l1 size, l2 size, max allowed
+    Tlb* tlb = new Tlb(64, 1024, 4);
+    // params: pid, pz, vpn, pfn
+
+    TlbEntry a = TlbEntry(1, 4096, 30, 60);
+    TlbEntry b = TlbEntry(1, 4096, 31, 61);
+    TlbEntry c = TlbEntry(1, 4096, 32, 62);
+    cout << "test l1 FIFO insert" << endl;
+    tlb->l1_insert(a,0); // a will disappear
+    for (int i=0; i<63; i++) {
+      tlb->l1_insert(b,0);
+    }
+    tlb->l1_insert(c,0);  // c will be the end
+
+    for (int i=0; i<tlb->l1_list->size(); i++) {
+      vector <TlbEntry>* temp = tlb->l1_list;
+      cout << (*temp)[i].vpn << endl;
+    }
+
+
+    cout << "test l2 FIFO insert" << endl;
+    tlb->l2_insert(a,0);
+    for (int i=0; i<255; i++) {
+      tlb->l2_insert(b,0);  //pid 5
+    }
+    tlb->l2_insert(c,0);
+
+    vector <vector <TlbEntry>*>* l2 = tlb->l2_list;
+    vector <TlbEntry>* temp = (*l2)[0];
+    cout << temp->front().vpn << endl; // expected 31
+    cout << temp->back().vpn << endl;  // expected 32
+
+    // TlbEntry a = TlbEntry(1, 4096, 30, 60);
+    // TlbEntry b = TlbEntry(1, 4096, 31, 61);
+    // TlbEntry c = TlbEntry(1, 4096, 32, 62);
+    // TlbEntry d = TlbEntry(1, 4096, 33, 63);
+    // TlbEntry e = TlbEntry(1, 4096, 34, 64);
+
+    // tlb->l1_insert(a,0);
+    // tlb->l1_insert(b,0);
+    // tlb->l1_insert(c,0);
+    // tlb->l1_insert(d,0);
+    // tlb->l1_insert(e,0);
+    // tlb->l2_insert(a,0);
+    // tlb->l2_insert(b,0);
+    // tlb->l2_insert(c,0);
+    // tlb->l2_insert(d,0);
+    // tlb->l2_insert(e,0);
+
+    // TlbEntry aa = TlbEntry(2, 4096, 30, 60);
+    // TlbEntry bb = TlbEntry(2, 4096, 31, 61);
+    // TlbEntry cc = TlbEntry(2, 4096, 32, 62);
+    // TlbEntry dd = TlbEntry(2, 4096, 33, 63);
+    // TlbEntry ee = TlbEntry(2, 4096, 34, 64);
+
+    // tlb->l2_insert(aa,0);
+    // tlb->l2_insert(bb,0);
+    // tlb->l2_insert(cc,0);
+    // tlb->l2_insert(dd,0);
+    // tlb->l2_insert(ee,0);
+
+    // tlb->invalidate_tlb(1, 33); //process_id, vpn
+    
+    // cout << tlb->l1_list->size() << endl;  // expected 4
+    // cout << (*tlb->l2_list)[0]->size() << endl;  // expected 4
+    // cout << (*tlb->l2_list)[1]->size() << endl;  // expected 5
+
+    // tlb->invalidate_tlb(2, 34);
+    // cout << (*tlb->l2_list)[1]->size() << endl;  // expected 4
+
+    delete tlb;
+
+    
+
+    cout << "No error occurs" << endl;
+    return 0;
+}
  */
\ No newline at end of file
@@ -1,91 +1,483 @@
-// tlb.h
-#ifndef TLB_H 
-#define TLB_H
-
-#include <stdint.h>
-#include <vector>
-#include <random>
-#include <ctime>
-#include <cmath>
-
-using namespace std;
-
-extern int L1_hit;
-extern int L2_hit;
-extern int TLB_miss;
-
-class TlbEntry {
-public:
-  uint32_t process_id; // get it from page table entry obj
-  uint32_t page_size;  // different page has different sizes, get it from page table entry obj
-                       // set mask according to page_size
-  uint32_t vpn;
-  uint32_t pfn;
-  uint32_t reference;  // only needed in LRU replacement policy
-
-  // constructor
-  TlbEntry(uint32_t process_id, uint32_t page_size, uint32_t vpn, uint32_t pfn);
-};
-
-class PTEntry {
-public:
-  uint32_t page_size;
-  uint32_t pfn;
-
-  PTEntry(uint32_t page_size, uint32_t pfn);
-};
-
-//two-level tlb
-class Tlb {
-public:
-  vector<TlbEntry>* l1_list;
-  vector<vector<TlbEntry>*>* l2_list;   
-  uint32_t l1_size;
-  uint32_t l2_size;
-  uint32_t max_process_allowed; // max number of processes that can exist in l2, default 4
-  uint32_t l2_size_per_process; // default 1024/4 = 256
-
-  // constructor
-	Tlb(uint32_t l1_size, uint32_t l2_size, uint32_t max_process_allowed);
-
-  // destructor
-  ~Tlb();
-
-  // pfn and page_size is obtained from page table entry obj
-  TlbEntry create_tlb_entry(uint32_t pfn, uint32_t page_size, uint32_t virtual_addr, uint32_t process_id);
-
-  // look_up(): given a virtual addr, look it up in both l1 and l2
-  // return pfn if found, -1 if miss
-  int look_up(uint32_t virtual_addr, uint32_t process_id);
-
-  // upon TLB hit, assemble physical address: use pfn and offset to form a physicai address
-  uint32_t assemble_physical_addr(TlbEntry tlb_entry, uint32_t virtual_addr);
-
-  // TLBs: insert a tlb entry into l1, random policy
-  // return -1 if no replacement occurs, return the replaced index in l1 if replacement occurs.
-  int l1_insert(TlbEntry entry);
-  // the following l1_insert() implememts a fifo policy. When calling the method, the parameter fifo can be any number (it's added only for method overloading)
-  int l1_insert(TlbEntry entry, int fifo);
-  //flush all
-  void l1_flush();
-  
-  // default: maximum 256 entries allowed per process
-  // random policy
-  void l2_insert(TlbEntry entry);
-  // the following l2_insert() implememts a fifo policy. When calling the method, the parameter fifo can be any number (it's added only for method overloading)
-  void l2_insert(TlbEntry entry, int fifo);
-
-  void invalidate_tlb(uint32_t process_id, uint32_t vpn);
-
-private:
-  // when a page is swapped out from RAM, delete (invalidate) the corresponding tlb entry
-  void l1_remove(uint32_t process_id, uint32_t vpn);
-
-  void l2_remove(uint32_t process_id, uint32_t vpn);
-
-  int random_generator(uint32_t start, uint32_t end);
-
-  //int replacingPolicy(int size);
-};
-
+// tlb.h
+#ifndef TLB_H 
+#define TLB_H
+
+#include <stdint.h>
+#include <vector>
+#include <random>
+#include <ctime>
+#include <cmath>
+#include <unordered_map>
+#include <map>
+#include "Stats.h"
+#include "StackDistance.h"
+#include "TlbPrefetcher.h"
+
+using namespace std;
+
+class TlbEntry {
+public:
+  uint32_t process_id; // get it from page table entry obj
+  uint32_t page_size;  // different page has different sizes, get it from page table entry obj
+                       // set mask according to page_size
+  uint64_t vpn;
+  uint32_t pfn;
+  bool prefetched = false; // installed by the prefetcher and not demanded yet
+
+  // constructor
+  TlbEntry(uint32_t process_id, uint32_t page_size, uint64_t vpn, uint32_t pfn);
+
+  // vpn is the first 4KB page of the mapping, which need not be aligned to page_size
+  bool covers(uint64_t virtual_addr) const {
+    return (virtual_addr >> 12) - vpn < (page_size >> 12);
+  }
+};
+
+// How a set-associative level picks the set for a page number.
+// TLB_HASH_MODULO uses the low bits, TLB_HASH_XOR folds the upper bits (and pid) in first
+// so strided page numbers do not pile up in a few sets.
+enum TlbIndexHash {
+  TLB_HASH_MODULO,
+  TLB_HASH_XOR
+};
+
+// Replacement policy of a tlb level, see the *Replacement policy classes below.
+enum TlbReplacement {
+  TLB_REPLACE_RANDOM,
+  TLB_REPLACE_FIFO,
+  TLB_REPLACE_LRU,
+  TLB_REPLACE_CLOCK,
+  TLB_REPLACE_SRRIP
+};
+
+// How l2 is shared between processes.
+// TLB_L2_STATIC: fully associative l2 is split into max_process_allowed fixed partitions, a new
+//   process beyond that flushes a whole partition; set-associative l2 is shared without control.
+// TLB_L2_UCP: one shared l2 (fully or set associative) with per-process quotas recomputed every
+//   ucp_epoch l2 lookups by utility-based partitioning, see UcpTlb.
+enum TlbL2Partitioning {
+  TLB_L2_STATIC,
+  TLB_L2_UCP
+};
+
+// TLB geometry. A level with ways == 0 is fully associative: one set for l1,
+// max_process_allowed per-process partitions for l2 (unless l2 is dynamically partitioned).
+struct TlbConfig {
+  uint32_t l1_size = 64;
+  uint32_t l2_size = 1024;
+  uint32_t max_process_allowed = 4;
+  uint32_t l1_ways = 0;
+  uint32_t l2_ways = 0;
+  TlbIndexHash index_hash = TLB_HASH_MODULO;
+  uint32_t seed = 0;             // random replacement seed, 0 = seed from the clock
+  TlbReplacement l1_policy = TLB_REPLACE_FIFO;
+  TlbReplacement l2_policy = TLB_REPLACE_FIFO;
+  TlbL2Partitioning l2_partitioning = TLB_L2_STATIC;
+  uint32_t ucp_epoch = 4096;
+  TlbPrefetchKind prefetcher = TLB_PREFETCH_NONE;
+  uint32_t prefetch_degree = 1;
+  uint32_t prefetch_buffer = 0;  // entries of a separate prefetch buffer, 0 = prefetch into l2
+  uint32_t pde_cache_size = 0;   // page-walk cache entries, 0 = every walk reads the directory
+  uint32_t pde_cache_ways = 0;
+  TlbReplacement pde_cache_policy = TLB_REPLACE_LRU;
+  uint32_t asid_bits = 0;        // 0: l1 is flushed on every switch, otherwise l1 entries carry an
+                                 // asid of this width and survive switches
+};
+
+// Replacement policies. Each one keeps its own per-slot state next to the entry array
+// and is plugged into TlbArray as a template parameter, so victim selection is inlined.
+// Interface:
+//   Policy(num_sets, ways, rng)
+//   on_insert(slot) / on_hit(slot)   slot = set * ways + way
+//   victim(set)                      slot to replace, only called when every way is valid
+//   reset()                          after a flush
+
+// uniform random way
+class RandomReplacement {
+public:
+  RandomReplacement(uint32_t num_sets, uint32_t ways, mt19937* rng) : ways(ways), rng(rng) {}
+  void on_insert(uint32_t slot) {}
+  void on_hit(uint32_t slot) {}
+  uint32_t victim(uint32_t set) { return set * ways + (*rng)() % ways; }
+  void reset() {}
+
+private:
+  uint32_t ways;
+  mt19937* rng;
+};
+
+// every set is a ring buffer: the cursor points at the oldest way and moves on after
+// each replacement, so inserting into a full set is O(1) and nothing is shifted
+class FifoReplacement {
+public:
+  FifoReplacement(uint32_t num_sets, uint32_t ways, mt19937* rng) : ways(ways), cursor(num_sets, 0) {}
+  void on_insert(uint32_t slot) {}
+  void on_hit(uint32_t slot) {}
+  uint32_t victim(uint32_t set) {
+    uint32_t way = cursor[set];
+    cursor[set] = way + 1 == ways ? 0 : way + 1;
+    return set * ways + way;
+  }
+  void reset() { fill(cursor.begin(), cursor.end(), 0); }
+
+private:
+  uint32_t ways;
+  vector<uint32_t> cursor;
+};
+
+// least recently used way, by access stamp
+class LruReplacement {
+public:
+  LruReplacement(uint32_t num_sets, uint32_t ways, mt19937* rng)
+    : ways(ways), stamp(num_sets * ways, 0), now(0) {}
+  void on_insert(uint32_t slot) { stamp[slot] = ++now; }
+  void on_hit(uint32_t slot) { stamp[slot] = ++now; }
+  uint32_t victim(uint32_t set) {
+    uint32_t first = set * ways, oldest = first;
+    for (uint32_t slot = first + 1; slot < first + ways; slot++) {
+      if (stamp[slot] < stamp[oldest]) {
+        oldest = slot;
+      }
+    }
+    return oldest;
+  }
+  void reset() { fill(stamp.begin(), stamp.end(), 0); now = 0; }
+
+private:
+  uint32_t ways;
+  vector<uint64_t> stamp;
+  uint64_t now;
+};
+
+// second chance: a hand sweeps each set, clearing reference bits until it finds a clear one
+class ClockReplacement {
+public:
+  ClockReplacement(uint32_t num_sets, uint32_t ways, mt19937* rng)
+    : ways(ways), referenced(num_sets * ways, 0), hand(num_sets, 0) {}
+  void on_insert(uint32_t slot) { referenced[slot] = 1; }
+  void on_hit(uint32_t slot) { referenced[slot] = 1; }
+  uint32_t victim(uint32_t set) {
+    uint32_t first = set * ways;
+    while (true) {
+      uint32_t slot = first + hand[set];
+      hand[set] = hand[set] + 1 == ways ? 0 : hand[set] + 1;
+      if (!referenced[slot]) {
+        return slot;
+      }
+      referenced[slot] = 0;
+    }
+  }
+  void reset() {
+    fill(referenced.begin(), referenced.end(), 0);
+    fill(hand.begin(), hand.end(), 0);
+  }
+
+private:
+  uint32_t ways;
+  vector<uint8_t> referenced;
+  vector<uint32_t> hand;
+};
+
+// static re-reference interval prediction with 2-bit RRPVs: new entries are predicted
+// "long" (2), hits "near" (0), the victim is the first way predicted "distant" (3)
+class SrripReplacement {
+public:
+  SrripReplacement(uint32_t num_sets, uint32_t ways, mt19937* rng)
+    : ways(ways), rrpv(num_sets * ways, max_rrpv) {}
+  void on_insert(uint32_t slot) { rrpv[slot] = max_rrpv - 1; }
+  void on_hit(uint32_t slot) { rrpv[slot] = 0; }
+  uint32_t victim(uint32_t set) {
+    uint32_t first = set * ways;
+    while (true) {
+      for (uint32_t slot = first; slot < first + ways; slot++) {
+        if (rrpv[slot] == max_rrpv) {
+          return slot;
+        }
+      }
+      for (uint32_t slot = first; slot < first + ways; slot++) {
+        rrpv[slot]++;
+      }
+    }
+  }
+  void reset() { fill(rrpv.begin(), rrpv.end(), max_rrpv); }
+
+private:
+  static constexpr uint8_t max_rrpv = 3;
+  uint32_t ways;
+  vector<uint8_t> rrpv;
+};
+
+// One tlb level (or l2 partition): the entries plus the replacement state.
+class TlbLevel {
+public:
+  virtual ~TlbLevel() {}
+  // return the matching entry or nullptr, a hit updates the replacement state
+  virtual TlbEntry* find(uint64_t virtual_addr, uint32_t process_id) = 0;
+  // like find() but without touching replacement state or counters
+  virtual bool contains(uint64_t virtual_addr, uint32_t process_id) const = 0;
+  // insert into the entry's set, replacing a victim of the policy when the set is full
+  // return -1 if no replacement occurs, the replaced slot otherwise
+  virtual int insert(const TlbEntry& entry) = 0;
+  virtual void remove(uint32_t process_id, uint64_t vpn) = 0;
+  virtual void flush() = 0;
+  virtual uint32_t occupancy() const = 0;
+};
+
+// N-way set-associative array of tlb entries (entries are pid tagged), one set of
+// size ways when fully associative.
+// Entries of different page sizes live in the same array, each indexed by the page-size aligned
+// window holding its first vpn, so a look up probes one set per page size currently cached
+// (two when an entry of that size starts off its alignment and may reach into the next window).
+// A fully associative array is simply scanned.
+class TlbArrayBase : public TlbLevel {
+public:
+  uint32_t occupancy() const override { return live; }
+  bool contains(uint64_t virtual_addr, uint32_t process_id) const override {
+    return locate(virtual_addr, process_id) >= 0;
+  }
+
+protected:
+  uint32_t num_sets;
+  uint32_t ways;
+  TlbIndexHash index_hash;
+  vector<TlbEntry> entries;      // num_sets * ways, page_size 0 marks an empty way
+  vector<uint32_t> set_live;     // valid ways in each set
+  uint32_t live;
+  uint32_t order_count[32];      // cached entries per page size order (log2(page_size) - 12)
+  uint32_t order_mask;           // bit i set when order_count[i] > 0
+  uint32_t unaligned_count[32];  // cached entries per order whose vpn is not aligned to the page size
+  uint32_t unaligned_mask;       // bit i set when unaligned_count[i] > 0
+
+  TlbArrayBase(uint32_t size, uint32_t ways, TlbIndexHash index_hash);
+
+  // slot of the entry covering virtual_addr / starting at vpn, -1 if none
+  int locate(uint64_t virtual_addr, uint32_t process_id) const;
+  int locate_vpn(uint32_t process_id, uint64_t vpn) const;
+  uint32_t set_of(const TlbEntry& entry) const;
+  // an empty slot of the set, -1 when the set is full
+  int free_slot(uint32_t set) const;
+  void place(uint32_t slot, const TlbEntry& entry);
+  void drop(uint32_t slot);
+  void clear();
+
+private:
+  uint32_t set_index(uint64_t page_number, uint32_t process_id) const;
+};
+
+template <typename Policy>
+class TlbArray : public TlbArrayBase {
+public:
+  TlbArray(uint32_t size, uint32_t ways, TlbIndexHash index_hash, mt19937* rng)
+    : TlbArrayBase(size, ways, index_hash), policy(num_sets, this->ways, rng) {}
+
+  TlbEntry* find(uint64_t virtual_addr, uint32_t process_id) override {
+    int slot = locate(virtual_addr, process_id);
+    if (slot < 0) {
+      return nullptr;
+    }
+    policy.on_hit(slot);
+    return &entries[slot];
+  }
+
+  int insert(const TlbEntry& entry) override {
+    uint32_t set = set_of(entry);
+    int slot = free_slot(set);
+    int replaced = -1;
+    if (slot < 0) {
+      slot = policy.victim(set);
+      drop(slot);
+      replaced = slot;
+    }
+    place(slot, entry);
+    policy.on_insert(slot);
+    return replaced;
+  }
+
+  void remove(uint32_t process_id, uint64_t vpn) override {
+    int slot = locate_vpn(process_id, vpn);
+    if (slot >= 0) {
+      drop(slot);
+    }
+  }
+
+  void flush() override {
+    clear();
+    policy.reset();
+  }
+
+private:
+  Policy policy;
+};
+
+// Shared l2 with utility-based partitioning (Qureshi & Patt, UCP).
+// Every process has a utility monitor: an LRU stack-distance profile of its own l2 stream
+// (hits and fills), which tells how many hits it would get from any number of entries.
+// At the end of each epoch the quotas are recomputed with the lookahead algorithm in units
+// of size / 64 entries, the monitors are decayed, and one L2ShareSample per process is
+// recorded. Replacement is LRU; a process at or above its quota (scaled to one set) replaces
+// its own LRU entry, otherwise the LRU entry of a process above its quota is taken.
+class UcpTlb : public TlbArrayBase {
+public:
+  UcpTlb(uint32_t size, uint32_t ways, TlbIndexHash index_hash, uint32_t epoch, SimStats* stats);
+
+  TlbEntry* find(uint64_t virtual_addr, uint32_t process_id) override;
+  int insert(const TlbEntry& entry) override;
+  void remove(uint32_t process_id, uint64_t vpn) override;
+  void flush() override;
+
+  uint32_t quota_of(uint32_t process_id) const;
+
+private:
+  struct Tenant {
+    uint32_t quota = 0;
+    uint32_t occupancy = 0;
+    uint64_t lookups = 0;      // this epoch
+    uint64_t hits = 0;
+    StackDistanceProfiler<TranslationKey> monitor;
+  };
+  map<uint32_t, Tenant> tenants;   // by pid
+  vector<uint64_t> stamp;          // lru stamps
+  uint64_t now;
+  uint32_t epoch;
+  uint64_t epoch_lookups;
+  uint64_t total_lookups;
+  uint32_t unit;                   // allocation granule in entries
+  SimStats* stats;
+
+  Tenant& tenant(uint32_t process_id);
+  uint32_t set_quota(const Tenant& tenant) const;
+  uint32_t choose_victim(uint32_t set, uint32_t process_id);
+  void end_epoch();
+  void repartition();
+};
+
+// build a level with the given policy; ways == 0 makes it fully associative
+TlbLevel* make_tlb_level(uint32_t size, uint32_t ways, TlbIndexHash index_hash,
+                         TlbReplacement policy, mt19937* rng);
+
+// where a look up was satisfied
+enum TlbHitLevel {
+  TLB_LEVEL_MISS,
+  TLB_LEVEL_L1,
+  TLB_LEVEL_L2
+};
+
+// result of Tlb::lookup(), pfn, page_size and vpn are only meaningful on a hit
+struct TlbLookupResult {
+  TlbHitLevel level;
+  uint32_t pfn;
+  uint32_t page_size;
+  uint64_t vpn;                  // first 4KB page of the mapping
+
+  bool hit() const { return level != TLB_LEVEL_MISS; }
+};
+
+class PTEntry {
+public:
+  uint32_t page_size;
+  uint32_t pfn;
+
+  PTEntry(uint32_t page_size, uint32_t pfn);
+};
+
+//two-level tlb
+class Tlb {
+public:
+  uint32_t l1_size;
+  uint32_t l2_size;
+  uint32_t max_process_allowed; // max number of processes that can exist in l2, default 4
+  uint32_t l2_size_per_process; // default 1024/4 = 256
+  TlbReplacement l2_policy;
+  TlbLevel* l1;                 // one array, set-associative or fully associative
+  TlbLevel* l2_shared;          // l2 shared by all processes (set-associative or UCP), nullptr when
+                                // statically partitioned
+  vector<TlbLevel*> l2_partitions;  // fully associative l2: one partition per process, oldest first
+  vector<int64_t> l2_owner;         // pid owning each partition, -1 when free
+  TlbLevel* prefetch_buffer;    // fully associative FIFO, nullptr when prefetches go to l2
+  TlbLevel* pde_cache;          // page-walk cache, nullptr when disabled
+  SimStats* stats;              // hit / miss counters, owned by the os
+  mt19937 rng;                  // random replacement
+  uint32_t asid_bits;           // 0 = no asids
+  unordered_map<uint32_t, uint32_t> asid_of;   // pid -> asid of the current generation
+  uint32_t next_asid;
+
+  // constructor
+	Tlb(uint32_t l1_size, uint32_t l2_size, uint32_t max_process_allowed);
+  Tlb(const TlbConfig& config, SimStats* stats);
+
+  // destructor
+  ~Tlb();
+  Tlb(const Tlb&) = delete;
+  Tlb& operator=(const Tlb&) = delete;
+
+  // pfn, page_size and vpn (first 4KB page of the mapping) are obtained from page table entry obj
+  TlbEntry create_tlb_entry(uint32_t pfn, uint32_t page_size, uint64_t vpn, uint32_t process_id);
+
+  // lookup(): given a virtual addr, look it up in l1 then l2, never throws
+  // an l2 hit is copied into l1, a miss is counted in stats->TLB_miss
+  TlbLookupResult lookup(uint64_t virtual_addr, uint32_t process_id);
+
+  // look_up(): given a virtual addr, look it up in both l1 and l2
+  // return pfn if found, -1 if miss
+  int look_up(uint64_t virtual_addr, uint32_t process_id);
+
+  // after a miss, install the translation in l1 and l2 without looking it up again
+  void fill(const TlbEntry& entry);
+
+  // install a prefetched translation in the prefetch buffer, or in l2 when there is none
+  void prefetch_fill(const TlbEntry& entry);
+  // true if any level already holds a translation for virtual_addr, no side effects
+  bool contains(uint64_t virtual_addr, uint32_t process_id);
+
+  // upon TLB hit, assemble physical address: use pfn and offset to form a physicai address
+  uint64_t assemble_physical_addr(TlbEntry tlb_entry, uint64_t virtual_addr);
+
+  // insert a tlb entry into l1 with the l1 policy
+  // return -1 if no replacement occurs, return the replaced slot in l1 if replacement occurs.
+  int l1_insert(const TlbEntry& entry);
+  //flush all
+  void l1_flush();
+
+  // context switch to process_id: without asids l1 is flushed, with asids the process keeps
+  // (or is given) an asid and l1 is only flushed when the asid space wraps
+  // return true if l1 was flushed
+  bool switch_process(uint32_t process_id);
+  
+  // insert with the l2 policy, into the process's partition when l2 is partitioned
+  // default: maximum 256 entries allowed per process
+  void l2_insert(const TlbEntry& entry);
+
+  void invalidate_tlb(uint32_t process_id, uint64_t vpn);
+
+  // page-walk (PDE) cache, keyed on (pid, directory slot: PageTable::directorySlot()). An entry
+  // says the slot points to a PTE page, so a walk that hits skips every directory read.
+  // Entries are stored as 4MB TlbEntries (vpn = dir_index << 10) in an ordinary TlbLevel.
+  // lookup returns false when the cache is disabled
+  bool pde_lookup(uint32_t process_id, uint64_t dir_index);
+  void pde_fill(uint32_t process_id, uint64_t dir_index);
+  // the PTE page behind dir_index may be gone: drop the cached entry
+  void pde_invalidate(uint32_t process_id, uint64_t dir_index);
+
+private:
+  // when a page is swapped out from RAM, delete (invalidate) the corresponding tlb entry
+  void l1_remove(uint32_t process_id, uint64_t vpn);
+
+  void l2_remove(uint32_t process_id, uint64_t vpn);
+
+  // tag of process_id in l1: the process id itself, or its asid
+  uint32_t l1_tag(uint32_t process_id);
+  // give process_id a fresh asid, starting a new generation when they run out
+  uint32_t assign_asid(uint32_t process_id);
+
+  // partition of process_id, -1 if it has none
+  int l2_partition_of(uint32_t process_id) const;
+
+  // uniform in [start, end)
+  int random_generator(uint32_t start, uint32_t end);
+
+  SimStats own_stats;           // used when no os supplies counters
+
+  //int replacingPolicy(int size);
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,161 @@
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Trace.h"
+
+using namespace std;
+
+static const char* const opcodeNames[] = {
+    "alloc", "free", "access_stak", "access_heap", "access_code", "switch"
+};
+
+Opcode opcodeFromName(const string& name) {
+    for (int op = OP_ALLOC; op < OP_INVALID; op++) {
+        if (name == opcodeNames[op]) {
+            return Opcode(op);
+        }
+    }
+    return OP_INVALID;
+}
+
+const char* opcodeName(Opcode opcode) {
+    return opcode < OP_INVALID ? opcodeNames[opcode] : "invalid";
+}
+
+// 1. constructor
+//    map the file if it starts with the binary magic, otherwise read it as text
+TraceReader::TraceReader(const char* path)
+    : fd(-1), mapping(nullptr), mappingSize(0), records(nullptr), legacyRecords(nullptr), recordCount(0),
+      position(0) {
+    if (openBinary(path)) {
+        return;
+    }
+    text.open(path);
+    if (!text) {
+        throw runtime_error(string("Unable to open trace ") + path);
+    }
+}
+
+TraceReader::~TraceReader() {
+    if (mapping) {
+        munmap(mapping, mappingSize);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool TraceReader::openBinary(const char* path) {
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error(string("Unable to open trace ") + path);
+    }
+    struct stat st;
+    TraceHeader header;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(header)
+        || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+        || memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    // the destructor does not run when the constructor throws, so fd is closed here
+    size_t recordSize = header.version == 1 ? sizeof(TraceRecordV1) : sizeof(TraceRecord);
+    if ((header.version != 1 && header.version != TRACE_VERSION) || header.recordSize != recordSize
+        || header.recordCount > ((size_t)st.st_size - sizeof(header)) / recordSize) {
+        close(fd);
+        fd = -1;
+        throw runtime_error(string("Corrupt binary trace header in ") + path);
+    }
+    mappingSize = st.st_size;
+    mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        close(fd);
+        fd = -1;
+        throw runtime_error(string("Unable to map trace ") + path);
+    }
+    madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+    const char* first = static_cast<const char*>(mapping) + sizeof(header);
+    if (header.version == 1) {
+        legacyRecords = reinterpret_cast<const TraceRecordV1*>(first);
+    } else {
+        records = reinterpret_cast<const TraceRecord*>(first);
+    }
+    recordCount = header.recordCount;
+    return true;
+}
+
+// 2. text records: "pid instruction [hex value] [core]", switch has no value
+const TraceRecord* TraceReader::nextText() {
+    while (getline(text, line)) {
+        const char* p = line.c_str();
+        char* end;
+        current.pid = strtoul(p, &end, 10);
+        p = end;
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        const char* name = p;
+        while (*p && *p != ' ' && *p != '\t' && *p != '\r') {
+            p++;
+        }
+        if (p == name) {
+            continue;   // blank line
+        }
+        string instruction(name, p - name);
+        current.opcode = opcodeFromName(instruction);
+        current.core = 0;
+        current.value = 0;
+        if (current.opcode != OP_SWITCH) {
+            current.value = strtoull(p, &end, 16);
+            if (end == p) {
+                cerr << "Error parsing value for instruction: " << instruction << endl;
+                continue;
+            }
+            p = end;
+        }
+        unsigned long core = strtoul(p, &end, 10);
+        if (end != p) {
+            current.core = uint16_t(core + 1);
+        }
+        return &current;
+    }
+    return nullptr;
+}
+
+// 3. text -> binary converter
+size_t convertTextTrace(const char* textPath, const char* binaryPath) {
+    TraceReader reader(textPath);
+    if (reader.isBinary()) {
+        throw runtime_error(string(textPath) + " is already a binary trace");
+    }
+    ofstream out(binaryPath, ios::binary | ios::trunc);
+    if (!out) {
+        throw runtime_error(string("Unable to create ") + binaryPath);
+    }
+    TraceHeader header;
+    memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.version = TRACE_VERSION;
+    header.recordSize = sizeof(TraceRecord);
+    header.recordCount = 0;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    while (const TraceRecord* record = reader.next()) {
+        out.write(reinterpret_cast<const char*>(record), sizeof(*record));
+        header.recordCount++;
+    }
+    // patch the record count now that it is known
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!out) {
+        throw runtime_error(string("Error writing ") + binaryPath);
+    }
+    return header.recordCount;
+}